@@ -0,0 +1,315 @@
+// batch.cpp - dependency-aware parallel script execution
+//
+// Each segment is analyzed up front: every line's accessed paths are made
+// absolute (lexically, against the segment's cwd) and checked against a
+// table of the last writer and the readers since then for each path, its
+// parent directories and anything below it. A line depends on earlier
+// writers of what it reads and on earlier readers and writers of what it
+// writes. Ready lines are started lowest line number first.
+#include "batch.h"
+#include "trace.h"
+#include "zygote.h"
+#include "fd_io.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <utility>
+
+struct BatchRunner::Job {
+    std::string line;
+    size_t line_no = 0;
+    std::vector<size_t> dependents; // later lines waiting for this one
+    size_t pending = 0;             // unfinished prerequisites
+    pid_t pid = -1;
+    int out_fd = -1;
+    int err_fd = -1;
+    int status = 0;
+    bool done = false;
+};
+
+// (path as written, true if the line may modify it)
+typedef std::vector<std::pair<std::string, bool>> Accesses;
+
+// commands that create, remove or rewrite every operand
+static const std::set<std::string> kWritesOperands = {
+    "rm", "rmdir", "mkdir", "touch", "mv", "tee", "truncate", "chmod", "chown",
+};
+
+static void collect_accesses(const CommandLine &cl, Accesses &acc) {
+    for (const auto &r : cl.redirections)
+        if (!r.path.empty()) acc.emplace_back(r.path, r.fd != STDIN_FILENO);
+    // a substituted command's accesses belong to the line running it
+    std::vector<bool> subst_word(cl.argv.size(), false);
+    for (const auto &ps : cl.substitutions) {
+        if (ps.redirect == -1 && ps.arg < subst_word.size()) subst_word[ps.arg] = true;
+        Parser parser;
+        for (const auto &stage : parser.splitPipeline(ps.command)) collect_accesses(parser.parse(stage), acc);
+    }
+    if (cl.argv.empty()) return;
+    const std::string &cmd = cl.argv[0];
+    std::vector<std::string> operands;
+    bool options = true;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (subst_word[i]) continue;
+        if (options && a == "--") { options = false; continue; }
+        if (options && a.size() > 1 && a[0] == '-') {
+            if (cmd == "sort") {
+                if (a == "-o" && i + 1 < cl.argv.size()) acc.emplace_back(cl.argv[++i], true);
+                else if (a.compare(0, 2, "-o") == 0 && a.size() > 2) acc.emplace_back(a.substr(2), true);
+                else if (a.compare(0, 9, "--output=") == 0) acc.emplace_back(a.substr(9), true);
+            }
+            continue;
+        }
+        operands.push_back(a);
+    }
+    bool all = kWritesOperands.count(cmd) != 0;
+    // cp and ln write only their destination
+    bool last = (cmd == "cp" || cmd == "ln") && operands.size() > 1;
+    for (size_t i = 0; i < operands.size(); ++i)
+        acc.emplace_back(operands[i], all || (last && i + 1 == operands.size()));
+}
+
+// absolute path with ".", ".." and repeated slashes resolved lexically
+static std::string normalize_path(const std::string &cwd, const std::string &p) {
+    std::string full = (!p.empty() && p[0] == '/') ? p : cwd + "/" + p;
+    std::vector<std::string> parts;
+    size_t i = 0;
+    while (i <= full.size()) {
+        size_t j = full.find('/', i);
+        if (j == std::string::npos) j = full.size();
+        std::string c = full.substr(i, j - i);
+        if (c == "..") { if (!parts.empty()) parts.pop_back(); }
+        else if (!c.empty() && c != ".") parts.push_back(c);
+        i = j + 1;
+    }
+    std::string out;
+    for (const auto &c : parts) { out += '/'; out += c; }
+    return out.empty() ? "/" : out;
+}
+
+// a glob pattern stands for the directory it searches, so it conflicts
+// with anything created there
+static std::string access_path(const std::string &cwd, const std::string &token) {
+    size_t wild = token.find_first_of("*?[");
+    if (wild == std::string::npos) return normalize_path(cwd, token);
+    size_t slash = token.rfind('/', wild);
+    return normalize_path(cwd, slash == std::string::npos ? "." : token.substr(0, slash + 1));
+}
+
+// devices such as /dev/null are shared freely
+static bool untracked(const std::string &p) {
+    return p == "/dev" || p.compare(0, 5, "/dev/") == 0 || p == "/proc" || p.compare(0, 6, "/proc/") == 0;
+}
+
+// unlinked temporary file holding one stream of a running line
+static int open_spool() {
+    const char *dir = getenv("TMPDIR");
+    if (!dir || dir[0] == '\0') dir = "/tmp";
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) return fd;
+    std::string path = std::string(dir) + "/teamshell-batchXXXXXX";
+    std::vector<char> tmpl(path.begin(), path.end());
+    tmpl.push_back('\0');
+    fd = mkostemp(tmpl.data(), O_CLOEXEC);
+    if (fd >= 0) unlink(tmpl.data());
+    return fd;
+}
+
+// copy a spool file to fd `to`
+static void replay(int from, int to) {
+    struct stat st;
+    if (fstat(from, &st) == 0) copy_range(from, 0, st.st_size, to);
+}
+
+static void close_spools(int &out_fd, int &err_fd) {
+    if (out_fd >= 0) close(out_fd);
+    if (err_fd >= 0) close(err_fd);
+    out_fd = err_fd = -1;
+}
+
+BatchRunner::BatchRunner(Shell &shell, int jobs) : shell_(shell), jobs_(jobs < 1 ? 1 : jobs) {}
+
+BatchRunner::LineKind BatchRunner::classify(const std::string &line) {
+    auto stages = parser_.splitPipeline(line);
+    if (stages.empty()) return kEmpty;
+    for (const auto &s : stages) if (parser_.parse(s).background) return kBarrier;
+    CommandLine first = parser_.parse(stages[0]);
+    if (first.argv.empty()) return kJob;
+    const std::string &cmd = first.argv[0];
+    if (cmd == "wait") return kWait;
+    if (cmd == "cd" || cmd == "set" || cmd == "exit") return kBarrier;
+    return kJob;
+}
+
+int BatchRunner::run(std::istream &in) {
+    std::vector<Job> seg;
+    std::string line;
+    while (true) {
+        bool more = static_cast<bool>(std::getline(in, line));
+        LineKind kind = kEmpty;
+        if (more) {
+            ++line_no_;
+            kind = classify(line);
+            if (kind == kEmpty) continue;
+            if (kind == kJob) {
+                Job job;
+                job.line = line;
+                job.line_no = line_no_;
+                seg.push_back(std::move(job));
+                continue;
+            }
+        }
+        if (!seg.empty()) {
+            int rc = runSegment(seg);
+            seg.clear();
+            if (rc != 0) return rc;
+        }
+        if (!more) return 0;
+        if (kind == kWait) continue;
+        // barriers change shell state, so they run here and not in a copy
+        shell_.handleLine(line);
+        flush_stdio();
+        if (shell_.lastStatus() != 0) {
+            fprintf(stderr, "teamshell: line %zu: exit status %d, stopping\n", line_no_, shell_.lastStatus());
+            return shell_.lastStatus();
+        }
+    }
+}
+
+void BatchRunner::analyze(std::vector<Job> &seg) {
+    char buf[4096];
+    std::string cwd = getcwd(buf, sizeof(buf)) ? buf : ".";
+    struct Access {
+        long writer = -1;
+        std::vector<size_t> readers; // since the last write
+    };
+    std::map<std::string, Access> table;
+    for (size_t j = 0; j < seg.size(); ++j) {
+        Accesses acc;
+        for (const auto &stage : parser_.splitPipeline(seg[j].line)) collect_accesses(parser_.parse(stage), acc);
+        std::vector<std::pair<std::string, bool>> paths;
+        for (const auto &a : acc) {
+            std::string p = access_path(cwd, a.first);
+            if (!untracked(p)) paths.emplace_back(p, a.second);
+        }
+        std::set<size_t> deps;
+        for (const auto &pa : paths) {
+            auto visit = [&](const Access &e) {
+                if (e.writer >= 0) deps.insert((size_t)e.writer);
+                if (pa.second) deps.insert(e.readers.begin(), e.readers.end());
+            };
+            // the path itself and every directory above it
+            for (std::string q = pa.first;;) {
+                auto it = table.find(q);
+                if (it != table.end()) visit(it->second);
+                if (q == "/") break;
+                size_t s = q.rfind('/');
+                q = s == 0 ? "/" : q.substr(0, s);
+            }
+            // everything below it
+            std::string below = pa.first == "/" ? "/" : pa.first + "/";
+            for (auto it = table.lower_bound(below);
+                 it != table.end() && it->first.compare(0, below.size(), below) == 0; ++it)
+                visit(it->second);
+        }
+        // record only after the lookups so a line never waits for itself
+        for (const auto &pa : paths) {
+            Access &e = table[pa.first];
+            if (pa.second) { e.writer = (long)j; e.readers.clear(); }
+            else e.readers.push_back(j);
+        }
+        deps.erase(j);
+        for (size_t d : deps) seg[d].dependents.push_back(j);
+        seg[j].pending = deps.size();
+    }
+}
+
+bool BatchRunner::launch(Job &job) {
+    job.out_fd = open_spool();
+    job.err_fd = open_spool();
+    if (job.out_fd < 0 || job.err_fd < 0) {
+        perror("teamshell: spool file");
+        close_spools(job.out_fd, job.err_fd);
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close_spools(job.out_fd, job.err_fd);
+        return false;
+    }
+    if (pid == 0) {
+        Zygote::release();
+        // concurrent lines cannot share the script's stdin
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) { dup2(null_fd, STDIN_FILENO); close(null_fd); }
+        dup2(job.out_fd, STDOUT_FILENO);
+        dup2(job.err_fd, STDERR_FILENO);
+        shell_.handleLine(job.line);
+        flush_stdio();
+        Tracer::flushBeforeExit();
+        _exit(shell_.lastStatus() & 0xff);
+    }
+    job.pid = pid;
+    return true;
+}
+
+int BatchRunner::runSegment(std::vector<Job> &seg) {
+    analyze(seg);
+    flush_stdio();
+    std::set<size_t> ready;
+    for (size_t i = 0; i < seg.size(); ++i) if (seg[i].pending == 0) ready.insert(i);
+    std::map<pid_t, size_t> running;
+    size_t stop = seg.size(); // first failed line; nothing after it starts
+    size_t next_out = 0;
+    while (true) {
+        while ((int)running.size() < jobs_ && !ready.empty() && *ready.begin() < stop) {
+            size_t i = *ready.begin();
+            ready.erase(ready.begin());
+            if (!launch(seg[i])) {
+                seg[i].status = 1;
+                seg[i].done = true;
+                stop = std::min(stop, i);
+                continue;
+            }
+            running[seg[i].pid] = i;
+        }
+        // replay finished output in script order
+        while (next_out < seg.size() && next_out <= stop && seg[next_out].done) {
+            Job &job = seg[next_out++];
+            replay(job.out_fd, STDOUT_FILENO);
+            replay(job.err_fd, STDERR_FILENO);
+            close_spools(job.out_fd, job.err_fd);
+        }
+        if (running.empty()) break;
+        int st = 0;
+        pid_t pid = waitpid(-1, &st, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("waitpid");
+            break;
+        }
+        auto it = running.find(pid);
+        if (it == running.end()) continue; // a background job started by a barrier
+        size_t i = it->second;
+        running.erase(it);
+        Job &job = seg[i];
+        job.done = true;
+        job.status = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+        if (job.status != 0) { stop = std::min(stop, i); continue; }
+        for (size_t d : job.dependents) if (--seg[d].pending == 0) ready.insert(d);
+    }
+    // lines after the failure may already have run; their output is dropped
+    for (auto &job : seg) close_spools(job.out_fd, job.err_fd);
+    if (stop == seg.size()) return 0;
+    fprintf(stderr, "teamshell: line %zu: exit status %d, stopping\n", seg[stop].line_no, seg[stop].status);
+    return seg[stop].status;
+}
@@ -0,0 +1,36 @@
+// batch.h - dependency-aware parallel execution of scripts (`teamshell -j N`)
+#ifndef TEAMSHELL_BATCH_H
+#define TEAMSHELL_BATCH_H
+
+#include "shell.h"
+#include <istream>
+#include <string>
+#include <vector>
+
+// Runs a script with up to `jobs` lines in flight. Lines between barriers
+// form a segment; within a segment a line waits only for earlier lines
+// whose files it touches (redirections, argv operands, paths written by
+// known file-modifying commands). `wait`, `cd`, `set`, `exit` and
+// background (`&`) lines are barriers and run in the shell itself once
+// everything before them has finished. Each line runs in a forked copy of
+// the shell with stdout/stderr spooled, and output is replayed in script
+// order. The first failing line stops the script: nothing after it is
+// started and its status is returned.
+class BatchRunner {
+public:
+    BatchRunner(Shell &shell, int jobs);
+    int run(std::istream &in);
+private:
+    struct Job;
+    enum LineKind { kEmpty, kJob, kBarrier, kWait };
+    LineKind classify(const std::string &line);
+    void analyze(std::vector<Job> &seg);
+    int runSegment(std::vector<Job> &seg);
+    bool launch(Job &job);
+    Shell &shell_;
+    Parser parser_;
+    int jobs_;
+    size_t line_no_ = 0;
+};
+
+#endif // TEAMSHELL_BATCH_H
@@ -0,0 +1,296 @@
+// shell_bench.cpp - latency/throughput benchmarks for teamshell
+//
+// Emits one JSON object per line (JSON Lines) so results can be diffed or
+// fed to a regression checker. Shell output produced while measuring is
+// sent to /dev/null; only the results go to stdout (or --out FILE).
+#include "shell.h"
+#include "parser.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <time.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+    int iterations = 50;
+    int warmup = 3;
+    size_t dataset_mb = 16;
+    std::string out_path;
+    std::string teamshell_path = "./teamshell";
+};
+
+static FILE *g_out = stdout;
+static int g_devnull = -1;
+static int g_saved_stdout = -1;
+static int g_saved_stderr = -1;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// silence shell output for the duration of a measurement
+static void mute() {
+    fflush(stdout); std::cout.flush();
+    dup2(g_devnull, STDOUT_FILENO);
+    dup2(g_devnull, STDERR_FILENO);
+}
+
+static void unmute() {
+    fflush(stdout); std::cout.flush();
+    dup2(g_saved_stdout, STDOUT_FILENO);
+    dup2(g_saved_stderr, STDERR_FILENO);
+}
+
+static std::string find_in_path(const std::string &name) {
+    const char *path = getenv("PATH");
+    if (!path) return name;
+    std::string p(path);
+    size_t start = 0;
+    while (start <= p.size()) {
+        size_t end = p.find(':', start);
+        if (end == std::string::npos) end = p.size();
+        std::string cand = p.substr(start, end - start) + "/" + name;
+        if (access(cand.c_str(), X_OK) == 0) return cand;
+        start = end + 1;
+    }
+    return name;
+}
+
+static std::string json_escape(const std::string &s) {
+    std::string o;
+    for (char c : s) {
+        if (c == '"' || c == '\\') { o.push_back('\\'); o.push_back(c); }
+        else if ((unsigned char)c < 0x20) { char b[8]; snprintf(b, sizeof(b), "\\u%04x", c); o += b; }
+        else o.push_back(c);
+    }
+    return o;
+}
+
+// run fn opts.iterations times (after warmup) and report latency stats;
+// bytes > 0 adds an MB/s figure, items > 0 an items/s figure
+static void measure(const BenchOptions &opts, const std::string &name, const std::string &what,
+                    const std::function<void()> &fn, size_t bytes = 0, size_t items = 0) {
+    for (int i = 0; i < opts.warmup; ++i) { mute(); fn(); unmute(); }
+    std::vector<double> samples;
+    samples.reserve(opts.iterations);
+    for (int i = 0; i < opts.iterations; ++i) {
+        mute();
+        double t0 = now_us();
+        fn();
+        double t1 = now_us();
+        unmute();
+        samples.push_back(t1 - t0);
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0; for (double s : samples) sum += s;
+    double mean = sum / samples.size();
+    auto pct = [&](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+    fprintf(g_out, "{\"bench\":\"%s\",\"command\":\"%s\",\"iterations\":%d,"
+                   "\"mean_us\":%.2f,\"p50_us\":%.2f,\"p95_us\":%.2f,\"min_us\":%.2f,\"max_us\":%.2f",
+            json_escape(name).c_str(), json_escape(what).c_str(), opts.iterations,
+            mean, pct(0.50), pct(0.95), samples.front(), samples.back());
+    if (bytes) fprintf(g_out, ",\"bytes\":%zu,\"mb_per_s\":%.2f", bytes, (bytes / 1048576.0) / (mean / 1e6));
+    if (items) fprintf(g_out, ",\"items\":%zu,\"items_per_s\":%.2f", items, items / (mean / 1e6));
+    fprintf(g_out, "}\n");
+    fflush(g_out);
+}
+
+// dataset: a text file of pseudo-random words and a directory of small files
+static size_t generate_dataset(const BenchOptions &opts) {
+    static const char *words[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot",
+                                  "golf", "hotel", "india", "juliet", "kilo", "lima", "error",
+                                  "warning", "info", "debug", "teamshell", "pipeline"};
+    const size_t nwords = sizeof(words) / sizeof(words[0]);
+    size_t target = opts.dataset_mb * 1048576;
+    FILE *f = fopen("data.txt", "w");
+    if (!f) { perror("bench: data.txt"); exit(1); }
+    unsigned seed = 12345;
+    size_t written = 0;
+    while (written < target) {
+        int n = 4 + (seed >> 16) % 8;
+        for (int i = 0; i < n; ++i) {
+            seed = seed * 1103515245 + 12345;
+            const char *w = words[(seed >> 16) % nwords];
+            written += fprintf(f, i ? " %s" : "%s", w);
+        }
+        seed = seed * 1103515245 + 12345;
+        written += fprintf(f, " %u\n", (seed >> 8) % 100000);
+    }
+    fclose(f);
+    mkdir("files", 0755);
+    for (int i = 0; i < 1000; ++i) {
+        char name[64]; snprintf(name, sizeof(name), "files/f%04d.%s", i, (i % 2) ? "txt" : "log");
+        int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) { if (write(fd, name, strlen(name)) < 0) perror("bench: write"); close(fd); }
+    }
+    return written;
+}
+
+static void bench_handle_line(const BenchOptions &opts, Shell &shell) {
+    struct Case { const char *name; std::string line; };
+    std::vector<Case> cases = {
+        {"handleLine.builtin", "pwd"},
+        {"handleLine.external", "true"},
+        {"handleLine.pipeline2", "echo x | cat"},
+        {"handleLine.pipeline4", "echo x | cat | cat | cat"},
+        {"handleLine.pipeline8", "echo x | cat | cat | cat | cat | cat | cat | cat"},
+        {"handleLine.glob", "echo files/*.txt"},
+        {"handleLine.builtin-redirect", "ls files > /dev/null"},
+        {"handleLine.builtin-redirect-stream", "wc -l < data.txt > /dev/null"},
+        {"handleLine.external-redirect", "/bin/ls files > /dev/null"},
+    };
+    for (const auto &c : cases)
+        measure(opts, c.name, c.line, [&]{ shell.handleLine(c.line); });
+}
+
+static void bench_parser(const BenchOptions &opts) {
+    const std::vector<std::string> lines = {
+        "ls -l /usr/bin",
+        "grep -n \"hello world\" file.txt > out.txt",
+        "cat < in.txt | sort | uniq -c | sort -rn | head -n 10",
+        "cp 'a file with spaces.txt' dest/ &",
+    };
+    const int reps = 20000;
+    size_t bytes = 0;
+    for (const auto &l : lines) bytes += l.size();
+    Parser parser;
+    size_t sink = 0;
+    measure(opts, "parser.throughput", "splitPipeline+parse", [&]{
+        for (int r = 0; r < reps; ++r)
+            for (const auto &l : lines)
+                for (const auto &s : parser.splitPipeline(l)) sink += parser.parse(s).argv.size();
+    }, bytes * reps, lines.size() * reps);
+    if (sink == 0) fprintf(stderr, "bench: parser produced no tokens\n");
+}
+
+static void bench_startup(const BenchOptions &opts) {
+    if (access(opts.teamshell_path.c_str(), X_OK) != 0) {
+        fprintf(stderr, "bench: %s not found, skipping startup benchmark\n", opts.teamshell_path.c_str());
+        return;
+    }
+    measure(opts, "startup.teamshell", opts.teamshell_path + " < /dev/null", [&]{
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(g_devnull, STDIN_FILENO);
+            execl(opts.teamshell_path.c_str(), opts.teamshell_path.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        int st; waitpid(pid, &st, 0);
+    });
+}
+
+static void bench_builtin_vs_coreutils(const BenchOptions &opts, Shell &shell, size_t data_bytes) {
+    struct Case { const char *name; const char *tool; std::string args; size_t bytes; size_t items; };
+    // no grep case: the grep builtin execs the external grep, so it would
+    // measure fork+exec, not builtin work
+    std::vector<Case> cases = {
+        {"cat", "cat", "data.txt", data_bytes, 0},
+        {"cp", "cp", "data.txt copy.txt", data_bytes, 0},
+        {"ls", "ls", "files", 0, 1000},
+        {"wc", "wc", "data.txt", data_bytes, 0},
+        {"wc-l", "wc", "-l data.txt", data_bytes, 0},
+        {"head", "head", "-n 1000 data.txt", 0, 1000},
+        {"tail", "tail", "-n 1000 data.txt", 0, 1000},
+        {"uniq-c", "uniq", "-c data.txt", data_bytes, 0},
+        {"sort", "sort", "data.txt", data_bytes, 0},
+        {"sort-n", "sort", "-n -k5 data.txt", data_bytes, 0},
+    };
+    for (const auto &c : cases) {
+        std::string builtin_line = std::string(c.tool) + " " + c.args;
+        std::string external_line = find_in_path(c.tool) + " " + c.args;
+        measure(opts, std::string("builtin.") + c.name, builtin_line,
+                [&]{ shell.handleLine(builtin_line); }, c.bytes, c.items);
+        measure(opts, std::string("coreutils.") + c.name, external_line,
+                [&]{ shell.handleLine(external_line); }, c.bytes, c.items);
+    }
+}
+
+// hashsum (thread pool, SHA-NI) against sha256sum on one large and many small files
+static void bench_hashsum(const BenchOptions &opts, Shell &shell, size_t data_bytes) {
+    struct Case { const char *name; std::string line; size_t bytes; size_t items; };
+    std::string sha256sum = find_in_path("sha256sum");
+    std::vector<Case> cases = {
+        {"builtin.hashsum", "hashsum data.txt", data_bytes, 0},
+        {"builtin.hashsum-xxh64", "hashsum -a xxh64 data.txt", data_bytes, 0},
+        {"coreutils.sha256sum", sha256sum + " data.txt", data_bytes, 0},
+        {"builtin.hashsum-files", "hashsum files/*.txt", 0, 500},
+        {"coreutils.sha256sum-files", sha256sum + " files/*.txt", 0, 500},
+    };
+    for (const auto &c : cases)
+        measure(opts, c.name, c.line, [&]{ shell.handleLine(c.line); }, c.bytes, c.items);
+}
+
+// pipe throughput of a 3-stage pipeline under each `place` policy
+static void bench_placement(const BenchOptions &opts, Shell &shell, size_t data_bytes) {
+    const char *policies[] = {"none", "adjacent", "node", "spread"};
+    for (const char *p : policies) {
+        std::string line = std::string("place -p ") + p + " -- cat data.txt | cat | cat > /dev/null";
+        measure(opts, std::string("placement.") + p, line, [&]{ shell.handleLine(line); }, data_bytes);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n iterations] [-w warmup] [-s dataset_mb] [-t teamshell] [-o out.jsonl]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opts;
+    int c;
+    while ((c = getopt(argc, argv, "n:w:s:t:o:h")) != -1) {
+        switch (c) {
+        case 'n': opts.iterations = std::max(1, atoi(optarg)); break;
+        case 'w': opts.warmup = std::max(0, atoi(optarg)); break;
+        case 's': opts.dataset_mb = std::max(1, atoi(optarg)); break;
+        case 't': opts.teamshell_path = optarg; break;
+        case 'o': opts.out_path = optarg; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    // resolve teamshell before changing into the scratch directory
+    char resolved[4096];
+    if (realpath(opts.teamshell_path.c_str(), resolved)) opts.teamshell_path = resolved;
+
+    g_saved_stdout = dup(STDOUT_FILENO);
+    g_saved_stderr = dup(STDERR_FILENO);
+    g_devnull = open("/dev/null", O_RDWR);
+    if (g_saved_stdout < 0 || g_saved_stderr < 0 || g_devnull < 0) { perror("bench"); return 1; }
+    if (!opts.out_path.empty()) {
+        g_out = fopen(opts.out_path.c_str(), "w");
+        if (!g_out) { perror(opts.out_path.c_str()); return 1; }
+    } else {
+        g_out = fdopen(dup(g_saved_stdout), "w");
+    }
+
+    char tmpl[] = "/tmp/teamshell-bench-XXXXXX";
+    if (!mkdtemp(tmpl)) { perror("mkdtemp"); return 1; }
+    if (chdir(tmpl) != 0) { perror("chdir"); return 1; }
+    size_t data_bytes = generate_dataset(opts);
+
+    Shell shell;
+    bench_handle_line(opts, shell);
+    bench_parser(opts);
+    bench_startup(opts);
+    bench_builtin_vs_coreutils(opts, shell, data_bytes);
+    bench_hashsum(opts, shell, data_bytes);
+    bench_placement(opts, shell, data_bytes);
+
+    // clean up scratch directory
+    if (chdir("/tmp") == 0) {
+        std::string rm = std::string("rm -rf ") + tmpl;
+        if (system(rm.c_str()) != 0) fprintf(stderr, "bench: failed to remove %s\n", tmpl);
+    }
+    fclose(g_out);
+    return 0;
+}
@@ -4,14 +4,17 @@
 
 #include "command.h"
 #include "builtin_registry.h"
+#include "redirect.h"
 
 class BuiltinCommand : public Command {
 public:
     BuiltinCommand(builtin_fn fn, const CommandLine &cl) : fn_(fn), cl_(cl) {}
     int execute(bool background) override {
         (void)background; // builtins run in-process
-        if (fn_) return fn_(cl_);
-        return 127;
+        if (!fn_) return 127;
+        RedirectGuard redirect;
+        if (!redirect.apply(cl_)) return 1;
+        return fn_(cl_);
     }
 private:
     builtin_fn fn_;
@@ -6,8 +6,10 @@ BuiltinRegistry &BuiltinRegistry::instance() {
     return inst;
 }
 
-void BuiltinRegistry::registerBuiltin(const std::string &name, builtin_fn fn) {
+void BuiltinRegistry::registerBuiltin(const std::string &name, builtin_fn fn, bool stream_safe) {
     map_[name] = fn;
+    if (stream_safe) stream_safe_[name] = fn;
+    else stream_safe_.erase(name);
 }
 
 builtin_fn BuiltinRegistry::lookup(const std::string &name) const {
@@ -15,3 +17,9 @@ builtin_fn BuiltinRegistry::lookup(const std::string &name) const {
     if (it == map_.end()) return nullptr;
     return it->second;
 }
+
+builtin_fn BuiltinRegistry::lookupStreamSafe(const std::string &name) const {
+    auto it = stream_safe_.find(name);
+    if (it == stream_safe_.end()) return nullptr;
+    return it->second;
+}
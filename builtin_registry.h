@@ -12,10 +12,14 @@ using builtin_fn = std::function<int(const CommandLine&)>;
 class BuiltinRegistry {
 public:
     static BuiltinRegistry &instance();
-    void registerBuiltin(const std::string &name, builtin_fn fn);
+    // stream_safe builtins only touch stdin/stdout/stderr and their file
+    // arguments, so they may also run inside a forked pipeline stage
+    void registerBuiltin(const std::string &name, builtin_fn fn, bool stream_safe = false);
     builtin_fn lookup(const std::string &name) const;
+    builtin_fn lookupStreamSafe(const std::string &name) const;
 private:
     std::unordered_map<std::string, builtin_fn> map_;
+    std::unordered_map<std::string, builtin_fn> stream_safe_;
 };
 
 #endif // TEAMSHELL_BUILTIN_REGISTRY_H
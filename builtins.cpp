@@ -1,4 +1,5 @@
 #include "builtins.h"
+#include "runtime_state.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -22,6 +23,10 @@ static void mode_to_str(mode_t mode, char *out) {
     out[9] = '\0';
 }
 
+// directory names are highlighted only on a terminal, not in redirected output
+static const char *dir_color_start() { return isatty(STDOUT_FILENO) ? "\033[1;37;44m" : ""; }
+static const char *dir_color_end() { return isatty(STDOUT_FILENO) ? "\033[0m" : ""; }
+
 static int list_directory_cpp(const std::string &path, bool show_all, bool long_format) {
     DIR *dir = opendir(path.c_str());
     if (!dir) { perror("ls"); return 1; }
@@ -67,8 +72,9 @@ static int list_directory_cpp(const std::string &path, bool show_all, bool long_
                        typeperm, (long)st.st_nlink, owner, group, (long)st.st_size, timebuf, name.c_str(), linktarget);
             } else if (S_ISDIR(st.st_mode)) {
                 char typeperm[32]; snprintf(typeperm, sizeof(typeperm), "%c%s", filetype, perms);
-                printf("%-11s %ld %s %s %5ld %s \033[1;37;44m%s\033[0m\n",
-                       typeperm, (long)st.st_nlink, owner, group, (long)st.st_size, timebuf, name.c_str());
+                printf("%-11s %ld %s %s %5ld %s %s%s%s\n",
+                       typeperm, (long)st.st_nlink, owner, group, (long)st.st_size, timebuf,
+                       dir_color_start(), name.c_str(), dir_color_end());
             } else {
                 char typeperm[32]; snprintf(typeperm, sizeof(typeperm), "%c%s", filetype, perms);
                 printf("%-11s %ld %s %s %5ld %s %s\n",
@@ -147,8 +153,9 @@ int ls_builtin(const CommandLine &cl) {
                            typeperm, (long)st.st_nlink, owner, group, (long)st.st_size, timebuf, target.c_str(), linktarget);
                 } else if (S_ISDIR(st.st_mode)) {
                     char typeperm[32]; snprintf(typeperm, sizeof(typeperm), "%c%s", filetype, perms);
-                    printf("%-11s %ld %s %s %5ld %s \033[1;37;44m%s\033[0m\n",
-                           typeperm, (long)st.st_nlink, owner, group, (long)st.st_size, timebuf, target.c_str());
+                    printf("%-11s %ld %s %s %5ld %s %s%s%s\n",
+                           typeperm, (long)st.st_nlink, owner, group, (long)st.st_size, timebuf,
+                           dir_color_start(), target.c_str(), dir_color_end());
                 } else {
                     char typeperm[32]; snprintf(typeperm, sizeof(typeperm), "%c%s", filetype, perms);
                     printf("%-11s %ld %s %s %5ld %s %s\n",
@@ -163,8 +170,9 @@ int ls_builtin(const CommandLine &cl) {
     return 0;
 }
 
-// grep builtin: perform parent-side globbing and insert --color=always if user
+// grep builtin: perform parent-side globbing and insert --color=auto if user
 // didn't provide a color option, then exec grep with the final argv.
+// (auto: grep colours only when its stdout, possibly redirected, is a tty)
 int grep_builtin(const CommandLine &cl) {
     if (cl.argv.empty()) return 1;
     // expand args (preserve argv[0] as program name)
@@ -195,7 +203,7 @@ int grep_builtin(const CommandLine &cl) {
 
     std::vector<std::string> final_argv;
     final_argv.push_back(expanded[0]);
-    if (!has_color) final_argv.push_back("--color=always");
+    if (!has_color) final_argv.push_back("--color=auto");
     for (size_t i = 1; i < expanded.size(); ++i) final_argv.push_back(expanded[i]);
 
     // prepare C-style argv
@@ -211,7 +219,7 @@ int grep_builtin(const CommandLine &cl) {
         _exit(127);
     }
     int status = 0;
-    waitpid(pid, &status, 0);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
     return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 }
 
@@ -231,6 +239,14 @@ static void register_my_builtins() {
     BuiltinRegistry::instance().registerBuiltin("mkdir", [](const CommandLine &cl){ return mkdir_builtin(cl); });
     BuiltinRegistry::instance().registerBuiltin("rmdir", [](const CommandLine &cl){ return rmdir_builtin(cl); });
     BuiltinRegistry::instance().registerBuiltin("cat", [](const CommandLine &cl){ return cat_builtin(cl); });
+    BuiltinRegistry::instance().registerBuiltin("taskset", [](const CommandLine &cl){ return taskset_builtin(cl); });
+    BuiltinRegistry::instance().registerBuiltin("wc", [](const CommandLine &cl){ return wc_builtin(cl); }, true);
+    BuiltinRegistry::instance().registerBuiltin("head", [](const CommandLine &cl){ return head_builtin(cl); }, true);
+    BuiltinRegistry::instance().registerBuiltin("tail", [](const CommandLine &cl){ return tail_builtin(cl); }, true);
+    BuiltinRegistry::instance().registerBuiltin("uniq", [](const CommandLine &cl){ return uniq_builtin(cl); }, true);
+    BuiltinRegistry::instance().registerBuiltin("follow", [](const CommandLine &cl){ return follow_builtin(cl); }, true);
+    BuiltinRegistry::instance().registerBuiltin("sort", [](const CommandLine &cl){ return sort_builtin(cl); }, true);
+    BuiltinRegistry::instance().registerBuiltin("hashsum", [](const CommandLine &cl){ return hashsum_builtin(cl); }, true);
 }
 
 // Simple implementations for common file-operation builtins.
@@ -345,17 +361,24 @@ int rmdir_builtin(const CommandLine &cl) {
 }
 
 int cat_builtin(const CommandLine &cl) {
-    if (cl.argv.size() < 2) { fprintf(stderr, "cat: missing operand\n"); return 2; }
+    // no operand (or "-") reads stdin, e.g. `cat < file`; this runs in the
+    // shell, so Ctrl-C (which sets `interrupted`) ends it with status 130
+    std::vector<std::string> files(cl.argv.begin() + 1, cl.argv.end());
+    if (files.empty()) files.push_back("-");
+    interrupted = 0;
     int ret = 0;
-    for (size_t i = 1; i < cl.argv.size(); ++i) {
-        const std::string &p = cl.argv[i];
-        int fd = open(p.c_str(), O_RDONLY);
+    for (const std::string &p : files) {
+        if (interrupted) break;
+        int fd = p == "-" ? STDIN_FILENO : open(p.c_str(), O_RDONLY);
         if (fd < 0) { perror((std::string("cat: ")+p).c_str()); ret = 1; continue; }
         char buf[8192]; ssize_t n;
-        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        while (!interrupted) {
+            n = read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
             if (write(STDOUT_FILENO, buf, n) != n) { perror("cat"); ret = 1; break; }
         }
-        close(fd);
+        if (fd != STDIN_FILENO) close(fd);
     }
-    return ret;
+    return interrupted ? 130 : ret;
 }
@@ -14,5 +14,21 @@ int ln_builtin(const CommandLine &cl);
 int mkdir_builtin(const CommandLine &cl);
 int rmdir_builtin(const CommandLine &cl);
 int cat_builtin(const CommandLine &cl);
+int taskset_builtin(const CommandLine &cl);
+
+// text_builtins.cpp
+int wc_builtin(const CommandLine &cl);
+int head_builtin(const CommandLine &cl);
+int tail_builtin(const CommandLine &cl);
+int uniq_builtin(const CommandLine &cl);
+
+// follow.cpp
+int follow_builtin(const CommandLine &cl);
+
+// sort.cpp
+int sort_builtin(const CommandLine &cl);
+
+// hashsum.cpp
+int hashsum_builtin(const CommandLine &cl);
 
 #endif // TEAMSHELL_BUILTINS_H
@@ -1,10 +1,16 @@
 // command.cpp - implementations for SimpleCommand and PipelineCommand
 #include "command.h"
 #include "runtime_state.h"
+#include "trace.h"
+#include "zygote.h"
+#include "builtin_registry.h"
+#include "redirect.h"
 #include <unistd.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <vector>
 #include <cstring>
 #include <cstdio>
@@ -12,93 +18,121 @@
 
 SimpleCommand::SimpleCommand(const CommandLine &cl) : cl_(cl) {}
 
-static void exec_cmd_argv_local(const CommandLine &cl) {
+void exec_command_line(const CommandLine &cl) {
     if (cl.argv.empty()) _exit(0);
     std::vector<char*> cargs;
     for (const auto &s : cl.argv) cargs.push_back(const_cast<char*>(s.c_str()));
     cargs.push_back(nullptr);
-    if (!cl.input_file.empty()) {
-        int fd = open(cl.input_file.c_str(), O_RDONLY);
-        if (fd < 0) { perror("open input"); _exit(127); }
-        dup2(fd, STDIN_FILENO);
-        close(fd);
-    }
-    if (!cl.output_file.empty()) {
-        int fd = open(cl.output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) { perror("open output"); _exit(127); }
-        dup2(fd, STDOUT_FILENO);
-        close(fd);
+    if (!apply_redirections(cl)) _exit(127);
+    // /dev/fd/N of our process substitutions must survive exec
+    for (const auto &ps : cl.substitutions) if (ps.fd >= 0) fcntl(ps.fd, F_SETFD, 0);
+    // stream-safe builtins (wc, head, ...) run right here instead of exec'ing
+    if (auto fn = BuiltinRegistry::instance().lookupStreamSafe(cl.argv[0])) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        int rc = fn(cl);
+        fflush(stdout);
+        Tracer::flushBeforeExit();
+        _exit(rc & 0xff);
     }
+    Tracer::flushBeforeExit();
     execvp(cargs[0], cargs.data());
     perror("execvp");
     _exit(127);
 }
 
 int SimpleCommand::execute(bool background) {
-    pid_t pid = fork();
-    if (pid < 0) { perror("fork"); return 1; }
-    if (pid == 0) {
-        // child: setpgid to its own pid
-        setpgid(0, 0);
-        exec_cmd_argv_local(cl_);
+    TraceSpan span("SimpleCommand::execute");
+    if (!cl_.argv.empty()) span.arg("argv0", cl_.argv[0]);
+    pid_t pid = -1;
+    bool via_zygote = false;
+    {
+        TraceSpan fork_span("fork");
+        // the zygote cannot see this shell's process substitution pipes
+        if (Zygote::available() && cl_.substitutions.empty()) {
+            pid = Zygote::spawn(cl_, 0, -1, -1, background, StagePlacement());
+            via_zygote = (pid > 0);
+        }
+        if (!via_zygote) {
+            pid = fork();
+            if (pid < 0) { perror("fork"); return 1; }
+            if (pid == 0) {
+                // child: setpgid to its own pid
+                setpgid(0, 0);
+                exec_command_line(cl_);
+            }
+        }
+        fork_span.arg("child_pid", pid);
+        fork_span.arg("zygote", via_zygote);
     }
-    // parent
-    setpgid(pid, pid);
+    // parent (the zygote already placed its child in a new group)
+    if (!via_zygote) setpgid(pid, pid);
     if (background) {
         printf("[Background] %d\n", (int)pid);
         return 0;
     }
     // foreground: set fg_pgid and wait
     fg_pgid = (sig_atomic_t)pid;
-    int status = 0; waitpid(pid, &status, 0);
+    int status = 0;
+    {
+        TraceSpan wait_span("waitpid");
+        wait_span.arg("pid", pid);
+        if (via_zygote) status = Zygote::wait(pid);
+        else while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        wait_span.arg("status", status);
+    }
     fg_pgid = 0;
     return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 }
 
-PipelineCommand::PipelineCommand(std::vector<CommandLine> stages) : stages_(std::move(stages)) {}
+PipelineCommand::PipelineCommand(std::vector<CommandLine> stages, PlacementPolicy placement)
+    : stages_(std::move(stages)), placement_(std::move(placement)) {}
 
 int PipelineCommand::execute(bool background) {
+    TraceSpan span("PipelineCommand::execute");
+    span.arg("stages", (long long)stages_.size());
     int n = stages_.size();
     if (n == 0) return 0;
+    std::vector<StagePlacement> plan = placement_.plan(n);
     int prev_fd = -1;
     std::vector<pid_t> pids;
+    std::vector<bool> via_zygote;
     pid_t pgid = 0;
     for (int i = 0; i < n; ++i) {
         int pipefd[2] = {-1, -1};
         if (i < n-1) {
             if (pipe(pipefd) < 0) { perror("pipe"); return 1; }
         }
-        pid_t pid = fork();
-        if (pid < 0) { perror("fork"); return 1; }
-        if (pid == 0) {
-            // child
-            if (pgid == 0) setpgid(0, 0); else setpgid(0, pgid);
-            if (prev_fd != -1) dup2(prev_fd, STDIN_FILENO);
-            if (i < n-1) dup2(pipefd[1], STDOUT_FILENO);
-            if (pipefd[0] != -1) close(pipefd[0]);
-            if (pipefd[1] != -1) close(pipefd[1]);
-            if (prev_fd != -1) close(prev_fd);
-            // redirections
-            if (!stages_[i].input_file.empty()) {
-                int fd = open(stages_[i].input_file.c_str(), O_RDONLY);
-                if (fd < 0) { perror("input redir"); _exit(127); }
-                dup2(fd, STDIN_FILENO); close(fd);
-            }
-            if (!stages_[i].output_file.empty()) {
-                int fd = open(stages_[i].output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd < 0) { perror("output redir"); _exit(127); }
-                dup2(fd, STDOUT_FILENO); close(fd);
+        TraceSpan fork_span("fork");
+        pid_t pid = -1;
+        bool zygote = false;
+        if (Zygote::available() && stages_[i].substitutions.empty()) {
+            pid = Zygote::spawn(stages_[i], pgid, prev_fd, pipefd[1], background, plan[i]);
+            zygote = (pid > 0);
+        }
+        if (!zygote) {
+            pid = fork();
+            if (pid < 0) { perror("fork"); return 1; }
+            if (pid == 0) {
+                // child
+                if (pgid == 0) setpgid(0, 0); else setpgid(0, pgid);
+                if (prev_fd != -1) dup2(prev_fd, STDIN_FILENO);
+                if (i < n-1) dup2(pipefd[1], STDOUT_FILENO);
+                if (pipefd[0] != -1) close(pipefd[0]);
+                if (pipefd[1] != -1) close(pipefd[1]);
+                if (prev_fd != -1) close(prev_fd);
+                apply_stage_placement(plan[i]);
+                exec_command_line(stages_[i]);
             }
-            std::vector<char*> cargs;
-            for (const auto &s : stages_[i].argv) cargs.push_back(const_cast<char*>(s.c_str()));
-            cargs.push_back(nullptr);
-            execvp(cargs[0], cargs.data());
-            perror("execvp");
-            _exit(127);
         }
+        fork_span.arg("child_pid", pid);
+        fork_span.arg("stage", i);
+        fork_span.arg("zygote", zygote);
         if (pgid == 0) pgid = pid;
-        setpgid(pid, pgid);
+        if (!zygote) setpgid(pid, pgid);
         pids.push_back(pid);
+        via_zygote.push_back(zygote);
         if (prev_fd != -1) close(prev_fd);
         if (pipefd[1] != -1) close(pipefd[1]);
         prev_fd = (pipefd[0] != -1) ? pipefd[0] : -1;
@@ -109,7 +143,18 @@ int PipelineCommand::execute(bool background) {
         return 0;
     }
     fg_pgid = (sig_atomic_t)pgid;
-    for (pid_t p : pids) { int st; waitpid(p, &st, 0); }
+    int last = 0;
+    for (size_t k = 0; k < pids.size(); ++k) {
+        pid_t p = pids[k];
+        TraceSpan wait_span("waitpid");
+        wait_span.arg("pid", p);
+        int st = 0;
+        if (via_zygote[k]) st = Zygote::wait(p);
+        else while (waitpid(p, &st, 0) < 0 && errno == EINTR) {}
+        wait_span.arg("status", st);
+        last = st;
+    }
     fg_pgid = 0;
-    return 0;
+    // like sh, a pipeline's status is that of its last stage
+    return WIFEXITED(last) ? WEXITSTATUS(last) : 1;
 }
@@ -3,9 +3,13 @@
 #define TEAMSHELL_COMMAND_H
 
 #include "parser.h"
+#include "placement.h"
 #include <memory>
 #include <vector>
 
+// apply cl's redirections and execvp it; only returns via _exit on failure
+[[noreturn]] void exec_command_line(const CommandLine &cl);
+
 class Command {
 public:
     virtual ~Command() = default;
@@ -23,10 +27,11 @@ private:
 
 class PipelineCommand : public Command {
 public:
-    explicit PipelineCommand(std::vector<CommandLine> stages);
+    explicit PipelineCommand(std::vector<CommandLine> stages, PlacementPolicy placement = PlacementPolicy());
     int execute(bool background) override;
 private:
     std::vector<CommandLine> stages_;
+    PlacementPolicy placement_;
 };
 
 #endif // TEAMSHELL_COMMAND_H
@@ -3,19 +3,43 @@
 #include "command.h"
 #include "builtin_registry.h"
 #include "builtin_command.h"
+#include "trace.h"
+#include "memo.h"
+#include "follow.h"
 
 std::unique_ptr<Command> CommandFactory::createFromLines(const std::vector<CommandLine>& lines) const {
+    TraceSpan span("CommandFactory::createFromLines");
+    span.arg("stages", (long long)lines.size());
     if (lines.empty()) return nullptr;
+    // `memo <line>`: build the command for the rest of the line and wrap it
+    if (!lines[0].argv.empty() && lines[0].argv[0] == "memo") {
+        std::vector<CommandLine> inner = lines;
+        inner[0].argv.erase(inner[0].argv.begin());
+        std::unique_ptr<Command> cmd;
+        if (!inner[0].argv.empty()) cmd = createFromLines(inner);
+        return std::make_unique<MemoCommand>(std::move(cmd), std::move(inner));
+    }
+    // `place [opts] <line>`: run the line as a pipeline with a placement policy
+    if (!lines[0].argv.empty() && lines[0].argv[0] == "place") {
+        std::vector<CommandLine> stages = lines;
+        PlacementPolicy policy;
+        if (!parse_placement_args(stages[0].argv, policy)) return nullptr;
+        return std::make_unique<PipelineCommand>(std::move(stages), std::move(policy));
+    }
     if (lines.size() == 1) {
         // single stage: check builtin registry first
         const CommandLine &cl = lines[0];
         if (!cl.argv.empty()) {
             auto fn = BuiltinRegistry::instance().lookup(cl.argv[0]);
-            if (fn) return std::make_unique<BuiltinCommand>(fn, cl);
+            // background and never-ending (follow) stream builtins run in a
+            // child via exec_command_line; redirections are applied in-process
+            bool needs_child = cl.background || follow_requested(cl);
+            if (fn && !(needs_child && BuiltinRegistry::instance().lookupStreamSafe(cl.argv[0])))
+                return std::make_unique<BuiltinCommand>(fn, cl);
         }
         return std::make_unique<SimpleCommand>(cl);
     }
-    // pipeline: create PipelineCommand; builtins inside pipelines are not run in-process
+    // pipeline: create PipelineCommand; stream-safe builtins run inside the stage children
     std::vector<CommandLine> stages = lines;
     return std::make_unique<PipelineCommand>(std::move(stages));
 }
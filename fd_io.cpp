@@ -0,0 +1,69 @@
+// fd_io.cpp - whole-buffer reads, writes and copies on raw fds
+#include "fd_io.h"
+#include "runtime_state.h"
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+
+// sendfile/pread step; small enough for an interrupted copy to stop quickly
+static const uint64_t kCopyStep = 8u << 20;
+
+void flush_stdio() {
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+}
+
+bool read_all(int fd, void *buf, size_t len) {
+    char *p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n; len -= n;
+    }
+    return true;
+}
+
+static bool put_all(int fd, const void *buf, size_t len, bool sock) {
+    const char *p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = sock ? send(fd, p, len, MSG_NOSIGNAL) : write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n; len -= n;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void *buf, size_t len) { return put_all(fd, buf, len, false); }
+
+bool send_all(int fd, const void *buf, size_t len) { return put_all(fd, buf, len, true); }
+
+bool copy_range(int src, off_t off, uint64_t len, int dst, off_t dst_off, bool interruptible) {
+    // sendfile cannot write at an offset or to an O_APPEND target
+    bool use_sendfile = dst_off < 0;
+    while (len > 0 && use_sendfile) {
+        if (interruptible && interrupted) return false;
+        ssize_t n = sendfile(dst, src, &off, std::min(len, kCopyStep));
+        if (n > 0) { len -= n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) { use_sendfile = false; break; }
+        return false;
+    }
+    char buf[65536];
+    while (len > 0) {
+        if (interruptible && interrupted) return false;
+        ssize_t n = pread(src, buf, std::min<uint64_t>(len, sizeof(buf)), off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        if (dst_off < 0) { if (!write_all(dst, buf, n)) return false; }
+        else { if (pwrite(dst, buf, n, dst_off) != n) return false; dst_off += n; }
+        off += n; len -= n;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+// fd_io.h - whole-buffer reads, writes and copies on raw fds
+#ifndef TEAMSHELL_FD_IO_H
+#define TEAMSHELL_FD_IO_H
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+
+// flush std::cout and every stdio stream; done before fork so children do
+// not inherit (and later repeat) buffered output
+void flush_stdio();
+
+// read exactly len bytes; false on EOF or error
+bool read_all(int fd, void *buf, size_t len);
+
+// write all len bytes, retrying short writes and EINTR; false on error
+bool write_all(int fd, const void *buf, size_t len);
+
+// write_all for a socket: a vanished peer fails the call instead of
+// raising SIGPIPE
+bool send_all(int fd, const void *buf, size_t len);
+
+// copy len bytes of src starting at off to dst, at dst_off or at dst's
+// current position if dst_off is -1 (sendfile when the target allows it).
+// With interruptible set the copy stops once `interrupted` is raised; only
+// callers that cleared the flag on entry should ask for that.
+bool copy_range(int src, off_t off, uint64_t len, int dst, off_t dst_off = -1,
+                bool interruptible = false);
+
+#endif // TEAMSHELL_FD_IO_H
@@ -0,0 +1,252 @@
+// follow.cpp - follow appended data in many files with one inotify instance
+//
+// Each followed name keeps an open fd and a read offset. File watches
+// report appends (IN_MODIFY), truncation and removal (IN_ATTRIB with
+// nlink 0, IN_MOVE_SELF, IN_DELETE_SELF); a watch on the parent directory
+// reports a new file appearing under the name after rotation. Only the
+// range between the saved offset and the current size is ever read.
+#include "follow.h"
+#include "builtins.h"
+#include "text_io.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+static const uint32_t kFileEvents = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+static const uint32_t kDirEvents = IN_CREATE | IN_MOVED_TO;
+
+bool follow_requested(const CommandLine &cl) {
+    if (cl.argv.empty()) return false;
+    if (cl.argv[0] == "follow") return true;
+    if (cl.argv[0] != "tail") return false;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (a == "--") break;
+        if (a == "-f" || a == "-F" || a == "--follow" || a.compare(0, 9, "--follow=") == 0) return true;
+    }
+    return false;
+}
+
+int follow_builtin(const CommandLine &cl) {
+    CommandLine tail = cl;
+    tail.argv[0] = "tail";
+    tail.argv.insert(tail.argv.begin() + 1, "-F");
+    return tail_builtin(tail);
+}
+
+struct Followed {
+    std::string name, dir, base;
+    int fd = -1;
+    int wd = -1;
+    off_t offset = 0;
+    dev_t dev = 0;
+    ino_t ino = 0;
+};
+
+class Follower {
+public:
+    Follower(bool show_headers, int last_shown) : headers_(show_headers), last_shown_(last_shown) {}
+    ~Follower() {
+        for (auto &f : files_) if (f.fd >= 0) close(f.fd);
+        if (ifd_ >= 0) close(ifd_);
+    }
+
+    int run(const std::vector<std::string> &names, const std::vector<off_t> &offsets) {
+        ifd_ = inotify_init1(IN_CLOEXEC);
+        if (ifd_ < 0) { perror("tail: inotify"); return 1; }
+        for (size_t i = 0; i < names.size(); ++i) {
+            Followed f;
+            f.name = names[i];
+            size_t slash = f.name.rfind('/');
+            f.dir = slash == std::string::npos ? "." : slash == 0 ? "/" : f.name.substr(0, slash);
+            f.base = slash == std::string::npos ? f.name : f.name.substr(slash + 1);
+            files_.push_back(f);
+        }
+        for (size_t i = 0; i < files_.size(); ++i) {
+            watchDir(i);
+            if (offsets[i] >= 0 && openFile(i)) {
+                files_[i].offset = offsets[i];
+                drain(i); // catch up on anything appended since the initial tail
+            }
+        }
+        out_.flush();
+        std::vector<char> buf(64 * 1024);
+        while (true) {
+            if (!anyWatched()) {
+                fprintf(stderr, "tail: no files remaining\n");
+                return 1;
+            }
+            ssize_t n = read(ifd_, buf.data(), buf.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { perror("tail: inotify read"); return 1; }
+            for (char *p = buf.data(); p < buf.data() + n;) {
+                struct inotify_event *ev = reinterpret_cast<struct inotify_event*>(p);
+                handle(*ev);
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+            out_.flush();
+            if (out_.failed()) return 1;
+        }
+    }
+
+private:
+    bool anyWatched() const {
+        if (!dir_wds_.empty()) return true;
+        for (const auto &f : files_) if (f.fd >= 0) return true;
+        return false;
+    }
+
+    bool openFile(size_t i) {
+        Followed &f = files_[i];
+        int fd = open(f.name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(fd); return false; }
+        f.fd = fd;
+        f.offset = 0;
+        f.dev = st.st_dev;
+        f.ino = st.st_ino;
+        f.wd = inotify_add_watch(ifd_, f.name.c_str(), kFileEvents);
+        if (f.wd >= 0) file_wds_[f.wd].push_back(i);
+        return true;
+    }
+
+    void closeFile(size_t i) {
+        Followed &f = files_[i];
+        if (f.wd >= 0) {
+            auto it = file_wds_.find(f.wd);
+            if (it != file_wds_.end()) {
+                auto &v = it->second;
+                for (size_t k = 0; k < v.size(); ++k) if (v[k] == i) { v.erase(v.begin() + k); break; }
+                // the same inode may be followed under another name
+                if (v.empty()) { inotify_rm_watch(ifd_, f.wd); file_wds_.erase(it); }
+            }
+        }
+        if (f.fd >= 0) close(f.fd);
+        f.fd = -1;
+        f.wd = -1;
+    }
+
+    void watchDir(size_t i) {
+        const std::string &dir = files_[i].dir;
+        int wd = inotify_add_watch(ifd_, dir.c_str(), kDirEvents | IN_ONLYDIR);
+        if (wd < 0) return;
+        auto &v = dir_wds_[wd];
+        for (size_t k : v) if (k == i) return;
+        v.push_back(i);
+    }
+
+    void header(size_t i) {
+        if (!headers_ || last_shown_ == (int)i) return;
+        out_.put("\n==> ");
+        out_.put(files_[i].name);
+        out_.put(" <==\n");
+        last_shown_ = (int)i;
+    }
+
+    // copy [offset, size) to stdout; a shrunken file restarts at 0
+    void drain(size_t i) {
+        Followed &f = files_[i];
+        struct stat st;
+        if (f.fd < 0 || fstat(f.fd, &st) != 0) return;
+        if (S_ISREG(st.st_mode) && st.st_size < f.offset) {
+            out_.flush();
+            fprintf(stderr, "tail: %s: file truncated\n", f.name.c_str());
+            f.offset = 0;
+        }
+        char buf[kChunkSize];
+        while (true) {
+            ssize_t r = pread(f.fd, buf, sizeof(buf), f.offset);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            header(i);
+            out_.put(buf, r);
+            f.offset += r;
+        }
+    }
+
+    // the name no longer refers to the file we hold: finish the old one and
+    // pick up whatever is at the name now
+    void reopen(size_t i) {
+        Followed &f = files_[i];
+        bool had = f.fd >= 0;
+        if (had) { drain(i); closeFile(i); }
+        out_.flush();
+        if (openFile(i)) {
+            fprintf(stderr, "tail: '%s' has %s;  following new file\n", f.name.c_str(),
+                    had ? "been replaced" : "appeared");
+            drain(i);
+        } else if (had) {
+            fprintf(stderr, "tail: '%s' has become inaccessible: %s\n", f.name.c_str(), strerror(errno));
+        }
+    }
+
+    // true if the name now resolves to a different inode (or nothing)
+    bool nameMoved(const Followed &f) const {
+        struct stat st;
+        if (stat(f.name.c_str(), &st) != 0) return true;
+        return st.st_dev != f.dev || st.st_ino != f.ino;
+    }
+
+    void handle(const struct inotify_event &ev) {
+        if (ev.mask & IN_Q_OVERFLOW) {
+            // events were lost: recheck everything
+            for (size_t i = 0; i < files_.size(); ++i) {
+                if (files_[i].fd >= 0 && !nameMoved(files_[i])) drain(i);
+                else reopen(i);
+            }
+            return;
+        }
+        auto dit = dir_wds_.find(ev.wd);
+        if (dit != dir_wds_.end()) {
+            if (ev.mask & IN_IGNORED) { dir_wds_.erase(dit); return; }
+            if (ev.len == 0) return;
+            std::vector<size_t> hits = dit->second;
+            for (size_t i : hits) {
+                const Followed &f = files_[i];
+                if (f.base == ev.name && (f.fd < 0 || nameMoved(f))) reopen(i);
+            }
+            return;
+        }
+        auto fit = file_wds_.find(ev.wd);
+        if (fit == file_wds_.end()) return;
+        if (ev.mask & IN_IGNORED) {
+            std::vector<size_t> gone = fit->second;
+            file_wds_.erase(fit);
+            for (size_t i : gone) files_[i].wd = -1;
+            return;
+        }
+        std::vector<size_t> targets = fit->second;
+        for (size_t i : targets) {
+            Followed &f = files_[i];
+            if (f.fd < 0) continue;
+            if (ev.mask & IN_MODIFY) { drain(i); continue; }
+            // IN_ATTRIB covers unlink while we hold the fd open
+            struct stat st;
+            bool unlinked = fstat(f.fd, &st) == 0 && st.st_nlink == 0;
+            if ((ev.mask & (IN_MOVE_SELF | IN_DELETE_SELF)) || unlinked || nameMoved(f)) reopen(i);
+            else drain(i);
+        }
+    }
+
+    int ifd_ = -1;
+    std::vector<Followed> files_;
+    std::map<int, std::vector<size_t>> file_wds_; // file watch -> followed indices
+    std::map<int, std::vector<size_t>> dir_wds_;  // directory watch -> followed indices
+    OutBuf out_;
+    bool headers_;
+    int last_shown_;
+};
+
+int follow_files(const std::vector<std::string> &names, const std::vector<off_t> &offsets,
+                 bool show_headers, int last_shown) {
+    Follower follower(show_headers, last_shown);
+    return follower.run(names, offsets);
+}
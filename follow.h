@@ -0,0 +1,23 @@
+// follow.h - inotify-based `tail -f` / `follow` support
+#ifndef TEAMSHELL_FOLLOW_H
+#define TEAMSHELL_FOLLOW_H
+
+#include "parser.h"
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+// true for `follow ...` and `tail -f/-F/--follow ...`; such commands never
+// return on their own, so they always run in a child the shell can signal
+bool follow_requested(const CommandLine &cl);
+
+// Watch names (by name, surviving rotation and truncation) with a single
+// inotify instance and copy appended bytes to stdout. offsets[i] is where
+// output of names[i] stopped (-1 = not open yet: print from the start once
+// it appears). last_shown is the index whose header was printed last, or
+// -1; headers are printed when output switches files. Runs until stdout
+// fails or no file can be watched any more.
+int follow_files(const std::vector<std::string> &names, const std::vector<off_t> &offsets,
+                 bool show_headers, int last_shown);
+
+#endif // TEAMSHELL_FOLLOW_H
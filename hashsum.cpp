@@ -0,0 +1,585 @@
+// hashsum.cpp - parallel file hashing builtin (SHA-256, XXH64)
+//
+// Files are hashed by a pool of worker threads and printed in argument
+// order as soon as each result is ready. Large regular files are mmap'd;
+// everything else is read into a per-thread page-aligned 1MB buffer.
+// SHA-256 uses the x86 SHA extensions when the CPU has them (checked once
+// with cpuid) and a portable implementation otherwise. Output and -c check
+// mode follow sha256sum.
+#include "builtins.h"
+#include "placement.h"
+#include "runtime_state.h"
+#include "text_io.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define TEAMSHELL_HAVE_SHANI 1
+#endif
+
+static const size_t kHashReadSize = 1024 * 1024;
+
+// ---- SHA-256 -----------------------------------------------------------
+
+static const uint32_t kSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static void sha256_blocks_scalar(uint32_t state[8], const uint8_t *data, size_t nblocks) {
+    for (; nblocks > 0; --nblocks, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 |
+                   (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + kSha256K[i] + w[i];
+            uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef TEAMSHELL_HAVE_SHANI
+// SHA-NI: two rounds per sha256rnds2, message schedule via sha256msg1/msg2
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t state[8], const uint8_t *data, size_t nblocks) {
+    const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);              // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);        // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);     // CDGH
+
+    for (; nblocks > 0; --nblocks, data += 64) {
+        const __m128i abef_save = state0, cdgh_save = state1;
+        __m128i msg[4];
+        for (int g = 0; g < 16; ++g) {
+            __m128i w;
+            if (g < 4) {
+                w = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), kByteSwap);
+            } else {
+                // W[t..t+3] from W[t-16..t-1]
+                __m128i x = _mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]);
+                x = _mm_add_epi32(x, _mm_alignr_epi8(msg[(g + 3) & 3], msg[(g + 2) & 3], 4));
+                w = _mm_sha256msg2_epu32(x, msg[(g + 3) & 3]);
+            }
+            msg[g & 3] = w;
+            __m128i wk = _mm_add_epi32(w, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&kSha256K[4 * g])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            wk = _mm_shuffle_epi32(wk, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);           // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);        // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);     // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);        // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+static bool cpu_has_sha() {
+    unsigned a, b, c, d;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+    bool sha = b & (1u << 29);
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    bool sse41 = c & (1u << 19), ssse3 = c & (1u << 9);
+    return sha && sse41 && ssse3;
+}
+#endif
+
+using sha256_blocks_fn = void (*)(uint32_t *, const uint8_t *, size_t);
+
+static sha256_blocks_fn pick_sha256_blocks() {
+#ifdef TEAMSHELL_HAVE_SHANI
+    if (cpu_has_sha()) return sha256_blocks_shani;
+#endif
+    return sha256_blocks_scalar;
+}
+
+static const sha256_blocks_fn sha256_blocks = pick_sha256_blocks();
+
+class Sha256 {
+public:
+    void update(const uint8_t *p, size_t n) {
+        total_ += n;
+        if (buffered_) {
+            size_t take = std::min(n, sizeof(buf_) - buffered_);
+            memcpy(buf_ + buffered_, p, take);
+            buffered_ += take; p += take; n -= take;
+            if (buffered_ < sizeof(buf_)) return;
+            sha256_blocks(state_, buf_, 1);
+            buffered_ = 0;
+        }
+        if (n >= 64) { sha256_blocks(state_, p, n / 64); p += n & ~size_t(63); n &= 63; }
+        memcpy(buf_, p, n);
+        buffered_ = n;
+    }
+    std::string hex() {
+        uint64_t bits = total_ * 8;
+        uint8_t pad[72] = {0x80};
+        size_t padlen = (buffered_ < 56 ? 56 : 120) - buffered_;
+        for (int i = 0; i < 8; ++i) pad[padlen + i] = (uint8_t)(bits >> (56 - 8 * i));
+        update(pad, padlen + 8);
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        for (uint32_t w : state_)
+            for (int s = 28; s >= 0; s -= 4) out.push_back(digits[(w >> s) & 0xF]);
+        return out;
+    }
+private:
+    uint32_t state_[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buf_[64];
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+// ---- XXH64 -------------------------------------------------------------
+
+static const uint64_t kXxhP1 = 11400714785074694791ULL, kXxhP2 = 14029467366897019727ULL,
+                      kXxhP3 = 1609587929392839161ULL, kXxhP4 = 9650029242287828579ULL,
+                      kXxhP5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+static inline uint64_t read64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }   // little-endian hosts
+static inline uint32_t read32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t xxh_round(uint64_t acc, uint64_t in) { return rotl64(acc + in * kXxhP2, 31) * kXxhP1; }
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t v) { return (acc ^ xxh_round(0, v)) * kXxhP1 + kXxhP4; }
+
+class Xxh64 {
+public:
+    void update(const uint8_t *p, size_t n) {
+        total_ += n;
+        if (buffered_) {
+            size_t take = std::min(n, sizeof(buf_) - buffered_);
+            memcpy(buf_ + buffered_, p, take);
+            buffered_ += take; p += take; n -= take;
+            if (buffered_ < sizeof(buf_)) return;
+            stripes(buf_, 1);
+            buffered_ = 0;
+        }
+        if (n >= 32) { stripes(p, n / 32); p += n & ~size_t(31); n &= 31; }
+        memcpy(buf_, p, n);
+        buffered_ = n;
+    }
+    std::string hex() {
+        uint64_t h = total_ >= 32 ? xxh_merge(xxh_merge(xxh_merge(xxh_merge(
+                                        rotl64(v_[0], 1) + rotl64(v_[1], 7) + rotl64(v_[2], 12) + rotl64(v_[3], 18),
+                                        v_[0]), v_[1]), v_[2]), v_[3])
+                                  : v_[2] + kXxhP5;
+        h += total_;
+        const uint8_t *p = buf_, *end = buf_ + buffered_;
+        for (; p + 8 <= end; p += 8) h = rotl64(h ^ xxh_round(0, read64(p)), 27) * kXxhP1 + kXxhP4;
+        if (p + 4 <= end) { h = rotl64(h ^ (read32(p) * kXxhP1), 23) * kXxhP2 + kXxhP3; p += 4; }
+        for (; p < end; ++p) h = rotl64(h ^ (*p * kXxhP5), 11) * kXxhP1;
+        h ^= h >> 33; h *= kXxhP2;
+        h ^= h >> 29; h *= kXxhP3;
+        h ^= h >> 32;
+        char out[17];
+        snprintf(out, sizeof(out), "%016llx", (unsigned long long)h);
+        return out;
+    }
+private:
+    void stripes(const uint8_t *p, size_t n) {
+        uint64_t a = v_[0], b = v_[1], c = v_[2], d = v_[3];
+        for (; n > 0; --n, p += 32) {
+            a = xxh_round(a, read64(p));
+            b = xxh_round(b, read64(p + 8));
+            c = xxh_round(c, read64(p + 16));
+            d = xxh_round(d, read64(p + 24));
+        }
+        v_[0] = a; v_[1] = b; v_[2] = c; v_[3] = d;
+    }
+    uint64_t v_[4] = {kXxhP1 + kXxhP2, kXxhP2, 0, (uint64_t)0 - kXxhP1}; // seed 0
+    uint8_t buf_[32];
+    size_t buffered_ = 0;
+    uint64_t total_ = 0;
+};
+
+// ---- hashing files -----------------------------------------------------
+
+enum class HashAlgo { Sha256, Xxh64 };
+
+// per-thread page-aligned read buffer, allocated once
+static uint8_t *read_buffer() {
+    struct Buffer {
+        void *p = nullptr;
+        ~Buffer() { free(p); }
+    };
+    thread_local Buffer buf;
+    if (!buf.p && posix_memalign(&buf.p, 4096, kHashReadSize) != 0) buf.p = nullptr;
+    return static_cast<uint8_t*>(buf.p);
+}
+
+template <typename Hasher>
+static bool hash_fd(int fd, std::string &hex, int &err) {
+    Hasher h;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { err = errno; return false; }
+    if (S_ISDIR(st.st_mode)) { err = EISDIR; return false; }
+    // large regular files are mapped; small ones are cheaper to read()
+    if (S_ISREG(st.st_mode) && st.st_size >= (off_t)kHashReadSize) {
+        void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            const uint8_t *p = static_cast<const uint8_t*>(m);
+            // feed in slices so readahead keeps up with hashing
+            for (off_t off = 0; off < st.st_size && !interrupted; off += kHashReadSize)
+                h.update(p + off, std::min<off_t>(kHashReadSize, st.st_size - off));
+            munmap(m, st.st_size);
+            if (interrupted) { err = EINTR; return false; }
+            hex = h.hex();
+            return true;
+        }
+    }
+    uint8_t *buf = read_buffer();
+    if (!buf) { err = ENOMEM; return false; }
+    ssize_t r;
+    while (true) {
+        if (interrupted) { err = EINTR; return false; }
+        r = read(fd, buf, kHashReadSize);
+        if (r < 0 && errno == EINTR && !interrupted) continue;
+        if (r <= 0) break;
+        h.update(buf, r);
+    }
+    if (r < 0) { err = errno; return false; }
+    hex = h.hex();
+    return true;
+}
+
+static bool hash_file(const std::string &name, HashAlgo algo, std::string &hex, int &err) {
+    int fd = name == "-" ? STDIN_FILENO : open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { err = errno; return false; }
+    bool ok = algo == HashAlgo::Sha256 ? hash_fd<Sha256>(fd, hex, err) : hash_fd<Xxh64>(fd, hex, err);
+    if (fd != STDIN_FILENO) close(fd);
+    return ok;
+}
+
+struct HashJob {
+    std::string name;
+    HashAlgo algo;
+    std::string expected;   // check mode only
+    std::string digest;
+    int err = 0;
+    bool ok = false;
+    bool done = false;
+};
+
+// hash every job with `threads` workers; emit(i) is called on the calling
+// thread for each job in order, as soon as that job is finished. After an
+// interrupt the remaining jobs are skipped and nothing more is emitted.
+template <typename Emit>
+static void run_jobs(std::vector<HashJob> &jobs, unsigned threads, Emit emit) {
+    std::atomic<size_t> next(0);
+    std::mutex mu;
+    std::condition_variable cv;
+    auto worker = [&] {
+        size_t i;
+        while ((i = next++) < jobs.size()) {
+            HashJob &j = jobs[i];
+            std::string digest;
+            int err = EINTR;
+            bool ok = !interrupted && hash_file(j.name, j.algo, digest, err);
+            std::lock_guard<std::mutex> lock(mu);
+            j.digest = std::move(digest);
+            j.err = err;
+            j.ok = ok;
+            j.done = true;
+            cv.notify_all();
+        }
+    };
+    threads = std::max(1u, std::min<unsigned>(threads, jobs.size()));
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            cv.wait(lock, [&] { return jobs[i].done; });
+        }
+        if (interrupted) break;
+        emit(i);
+    }
+    for (auto &t : pool) t.join();
+}
+
+// ---- sha256sum-compatible formatting -----------------------------------
+
+// names containing '\\' or '\n' are escaped and the line gets a leading '\\'
+static bool needs_escape(const std::string &name) { return name.find_first_of("\\\n") != std::string::npos; }
+
+static std::string escape_name(const std::string &name) {
+    std::string out;
+    for (char c : name) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\n') out += "\\n";
+        else out.push_back(c);
+    }
+    return out;
+}
+
+static bool unescape_name(const std::string &in, std::string &out) {
+    out.clear();
+    for (size_t i = 0; i < in.size(); ++i) {
+        if (in[i] != '\\') { out.push_back(in[i]); continue; }
+        if (++i == in.size()) return false;
+        if (in[i] == '\\') out.push_back('\\');
+        else if (in[i] == 'n') out.push_back('\n');
+        else return false;
+    }
+    return true;
+}
+
+static bool is_hex(const std::string &s) {
+    if (s.empty()) return false;
+    for (char c : s) if (!isxdigit((unsigned char)c)) return false;
+    return true;
+}
+
+static bool algo_for_length(size_t n, HashAlgo &algo) {
+    if (n == 64) { algo = HashAlgo::Sha256; return true; }
+    if (n == 16) { algo = HashAlgo::Xxh64; return true; }
+    return false;
+}
+
+// "HASH  NAME", "HASH *NAME" or BSD-style "SHA256 (NAME) = HASH"
+static bool parse_check_line(std::string line, bool algo_fixed, HashAlgo fixed, HashJob &job) {
+    bool escaped = !line.empty() && line[0] == '\\';
+    if (escaped) line.erase(0, 1);
+    std::string name, hash;
+    static const struct { const char *tag; HashAlgo algo; } tags[] = {
+        {"SHA256 (", HashAlgo::Sha256}, {"XXH64 (", HashAlgo::Xxh64},
+    };
+    bool tagged = false;
+    for (const auto &t : tags) {
+        size_t tl = strlen(t.tag);
+        if (line.compare(0, tl, t.tag) != 0) continue;
+        size_t eq = line.rfind(") = ");
+        if (eq == std::string::npos || eq < tl) return false;
+        name = line.substr(tl, eq - tl);
+        hash = line.substr(eq + 4);
+        if (algo_fixed && fixed != t.algo) return false;
+        job.algo = t.algo;
+        tagged = true;
+        break;
+    }
+    if (!tagged) {
+        size_t sp = line.find(' ');
+        if (sp == std::string::npos || sp + 2 > line.size()) return false;
+        if (line[sp + 1] != ' ' && line[sp + 1] != '*') return false;
+        hash = line.substr(0, sp);
+        name = line.substr(sp + 2);
+        HashAlgo guessed;
+        if (!algo_for_length(hash.size(), guessed)) return false;
+        job.algo = algo_fixed ? fixed : guessed;
+    }
+    if (!is_hex(hash) || hash.size() != (job.algo == HashAlgo::Sha256 ? 64u : 16u) || name.empty()) return false;
+    if (escaped && !unescape_name(name, job.name)) return false;
+    if (!escaped) job.name = name;
+    for (auto &c : hash) c = tolower((unsigned char)c);
+    job.expected = hash;
+    return true;
+}
+
+static std::string quote_if_spaced(const std::string &s) {
+    return s.find(' ') == std::string::npos ? s : "'" + s + "'";
+}
+
+static int check_list(const std::string &list, bool algo_fixed, HashAlgo algo, unsigned threads,
+                      bool quiet, bool status) {
+    std::string data;
+    {
+        int fd = list == "-" ? STDIN_FILENO : open(list.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { fprintf(stderr, "hashsum: %s: %s\n", list.c_str(), strerror(errno)); return 1; }
+        char buf[65536];
+        ssize_t r;
+        while ((r = read(fd, buf, sizeof(buf))) > 0 || (r < 0 && errno == EINTR && !interrupted))
+            if (r > 0) data.append(buf, r);
+        int err = errno;
+        if (fd != STDIN_FILENO) close(fd);
+        if (r < 0) {
+            if (!interrupted) fprintf(stderr, "hashsum: %s: %s\n", list.c_str(), strerror(err));
+            return 1;
+        }
+    }
+    std::vector<HashJob> jobs;
+    size_t bad_lines = 0;
+    for (size_t pos = 0; pos < data.size();) {
+        size_t nl = data.find('\n', pos);
+        if (nl == std::string::npos) nl = data.size();
+        std::string line = data.substr(pos, nl - pos);
+        pos = nl + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        HashJob job;
+        if (parse_check_line(line, algo_fixed, algo, job)) jobs.push_back(job);
+        else ++bad_lines;
+    }
+    if (jobs.empty()) {
+        fprintf(stderr, "hashsum: %s: no properly formatted checksum lines found\n",
+                quote_if_spaced(list == "-" ? "standard input" : list).c_str());
+        return 1;
+    }
+    size_t unreadable = 0, mismatched = 0;
+    OutBuf out;
+    run_jobs(jobs, threads, [&](size_t i) {
+        const HashJob &j = jobs[i];
+        // as in sha256sum -c, only names with newlines are shown escaped
+        std::string shown = j.name.find('\n') != std::string::npos ? "\\" + escape_name(j.name) : j.name;
+        if (!j.ok) {
+            ++unreadable;
+            out.flush();
+            fprintf(stderr, "hashsum: %s: %s\n", j.name.c_str(), strerror(j.err));
+            if (!status) { out.put(shown); out.put(": FAILED open or read\n"); }
+            return;
+        }
+        bool match = j.digest == j.expected;
+        if (!match) ++mismatched;
+        if (status || (quiet && match)) return;
+        out.put(shown);
+        out.put(match ? ": OK\n" : ": FAILED\n");
+    });
+    out.flush();
+    if (interrupted) return 1;
+    if (!status) {
+        if (bad_lines)
+            fprintf(stderr, "hashsum: WARNING: %zu %s improperly formatted\n", bad_lines, bad_lines == 1 ? "line is" : "lines are");
+        if (unreadable)
+            fprintf(stderr, "hashsum: WARNING: %zu listed %s could not be read\n", unreadable, unreadable == 1 ? "file" : "files");
+        if (mismatched)
+            fprintf(stderr, "hashsum: WARNING: %zu computed %s did NOT match\n", mismatched, mismatched == 1 ? "checksum" : "checksums");
+    }
+    return (unreadable || mismatched) ? 1 : 0;
+}
+
+// expand directories for -r; entries are visited in name order
+static void collect_files(const std::string &path, std::vector<std::string> &out) {
+    struct stat st;
+    if (path == "-" || stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) { out.push_back(path); return; }
+    DIR *d = opendir(path.c_str());
+    if (!d) { out.push_back(path); return; }
+    std::vector<std::string> names;
+    while (struct dirent *e = readdir(d)) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        names.push_back(e->d_name);
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    std::string prefix = path.back() == '/' ? path : path + "/";
+    for (const auto &n : names) collect_files(prefix + n, out);
+}
+
+// hashsum [-a sha256|xxh64] [-j N] [-r] [-c [--quiet] [--status]] [FILE...]
+int hashsum_builtin(const CommandLine &cl) {
+    HashAlgo algo = HashAlgo::Sha256;
+    bool algo_fixed = false, check = false, recursive = false, quiet = false, status = false;
+    unsigned threads = 0;
+    std::vector<std::string> args;
+    bool opts_done = false;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (opts_done || a == "-" || a.size() < 2 || a[0] != '-') { args.push_back(a); continue; }
+        if (a == "--") { opts_done = true; continue; }
+        if (a == "-c" || a == "--check") { check = true; continue; }
+        if (a == "-r" || a == "--recursive") { recursive = true; continue; }
+        if (a == "--quiet") { quiet = true; continue; }
+        if (a == "--status") { status = true; continue; }
+        if (a == "-a" || a == "-j") {
+            if (i + 1 >= cl.argv.size()) { fprintf(stderr, "hashsum: option requires an argument -- '%c'\n", a[1]); return 1; }
+            const std::string &v = cl.argv[++i];
+            if (a == "-a") {
+                if (v == "sha256") algo = HashAlgo::Sha256;
+                else if (v == "xxh64") algo = HashAlgo::Xxh64;
+                else { fprintf(stderr, "hashsum: unknown algorithm '%s' (sha256, xxh64)\n", v.c_str()); return 1; }
+                algo_fixed = true;
+            } else {
+                char *end;
+                long n = strtol(v.c_str(), &end, 10);
+                if (v.empty() || *end || n <= 0) { fprintf(stderr, "hashsum: invalid thread count '%s'\n", v.c_str()); return 1; }
+                threads = (unsigned)n;
+            }
+            continue;
+        }
+        fprintf(stderr, "hashsum: invalid option '%s'\n", a.c_str());
+        fprintf(stderr, "usage: hashsum [-a sha256|xxh64] [-j N] [-r] [-c [--quiet] [--status]] [FILE...]\n");
+        return 1;
+    }
+    if (threads == 0) threads = allowed_cpu_count();
+    if (args.empty()) args.push_back("-");
+    interrupted = 0;
+
+    if (check) {
+        int ret = 0;
+        for (const auto &list : args)
+            if (!interrupted && check_list(list, algo_fixed, algo, threads, quiet, status) != 0) ret = 1;
+        return interrupted ? 130 : ret;
+    }
+
+    std::vector<HashJob> jobs;
+    std::vector<std::string> files;
+    for (const auto &a : args) {
+        if (recursive) collect_files(a, files);
+        else files.push_back(a);
+    }
+    for (const auto &f : files) {
+        HashJob j;
+        j.name = f;
+        j.algo = algo;
+        jobs.push_back(j);
+    }
+    int ret = 0;
+    OutBuf out;
+    run_jobs(jobs, threads, [&](size_t i) {
+        const HashJob &j = jobs[i];
+        if (!j.ok) {
+            out.flush();
+            fprintf(stderr, "hashsum: %s: %s\n", j.name.c_str(), strerror(j.err));
+            ret = 1;
+            return;
+        }
+        if (needs_escape(j.name)) { out.put('\\'); out.put(j.digest); out.put("  "); out.put(escape_name(j.name)); }
+        else { out.put(j.digest); out.put("  "); out.put(j.name); }
+        out.put('\n');
+    });
+    return interrupted ? 130 : ret;
+}
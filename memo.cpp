@@ -0,0 +1,311 @@
+// memo.cpp - MemoCommand: on-disk output cache keyed by command inputs
+#include "memo.h"
+#include "trace.h"
+#include "redirect.h"
+#include "fd_io.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const char kEntryMagic[8] = {'T', 'S', 'M', 'E', 'M', 'O', '1', '\0'};
+
+struct EntryHeader {
+    char magic[8];
+    int32_t status;
+    uint32_t reserved;
+    uint64_t out_len;
+    uint64_t err_len;
+};
+
+// 128-bit FNV-1a variant that folds in 8 bytes per step for bulk data
+class Hasher {
+public:
+    void bytes(const void *data, size_t len) {
+        const unsigned char *p = static_cast<const unsigned char*>(data);
+        while (len >= 8) {
+            uint64_t w; memcpy(&w, p, 8);
+            h_ ^= w; h_ *= prime();
+            p += 8; len -= 8;
+        }
+        while (len--) { h_ ^= *p++; h_ *= prime(); }
+    }
+    void u64(uint64_t v) { bytes(&v, sizeof(v)); }
+    void str(const std::string &s) { u64(s.size()); bytes(s.data(), s.size()); }
+    std::string hex() const {
+        char buf[33];
+        snprintf(buf, sizeof(buf), "%016llx%016llx",
+                 (unsigned long long)(h_ >> 64), (unsigned long long)(uint64_t)h_);
+        return buf;
+    }
+private:
+    static unsigned __int128 prime() { return ((unsigned __int128)1 << 88) | 0x13B; }
+    unsigned __int128 h_ = ((unsigned __int128)0x6c62272e07bb0142ull << 64) | 0x62b821756295c58dull;
+};
+
+std::string memo_dir() {
+    const char *d = getenv("TEAMSHELL_MEMO_DIR");
+    if (d && d[0]) return d;
+    const char *home = getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/teamshell/memo";
+}
+
+uint64_t memo_max_bytes() {
+    const char *m = getenv("TEAMSHELL_MEMO_MAX_MB");
+    long mb = m ? atol(m) : 0;
+    if (mb <= 0) mb = 256;
+    return (uint64_t)mb << 20;
+}
+
+bool ensure_dir(const std::string &dir) {
+    for (size_t pos = 1; pos <= dir.size(); ++pos) {
+        if (pos != dir.size() && dir[pos] != '/') continue;
+        std::string part = dir.substr(0, pos);
+        if (mkdir(part.c_str(), 0700) != 0 && errno != EEXIST) {
+            perror(("memo: " + part).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// fold a named file's identity and content into the key
+void hash_path(Hasher &h, const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return;
+    if (S_ISDIR(st.st_mode)) {
+        h.str(path);
+        h.u64(st.st_mtim.tv_sec); h.u64(st.st_mtim.tv_nsec);
+        return;
+    }
+    if (!S_ISREG(st.st_mode)) return;
+    h.str(path);
+    h.u64(st.st_size);
+    h.u64(st.st_mtim.tv_sec); h.u64(st.st_mtim.tv_nsec);
+    if (st.st_size == 0) return;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    h.bytes(map, st.st_size);
+    munmap(map, st.st_size);
+}
+
+// an inherited stdin can be keyed only if it is a regular file (hashed
+// from the current offset on) or /dev/null; what is typed at a terminal or
+// arrives through a pipe, socket or other device is unknown
+bool stdin_keyable() {
+    struct stat st, null_st;
+    if (fstat(STDIN_FILENO, &st) != 0) return true; // closed: nothing to read
+    if (S_ISREG(st.st_mode)) return true;
+    return S_ISCHR(st.st_mode) && !isatty(STDIN_FILENO) &&
+           stat("/dev/null", &null_st) == 0 && st.st_rdev == null_st.st_rdev;
+}
+
+void hash_stdin(Hasher &h) {
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    off_t off = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (off < 0) off = 0;
+    h.str("<stdin>");
+    h.u64(st.st_size > off ? st.st_size - off : 0);
+    std::vector<char> buf(1 << 20);
+    ssize_t n;
+    while ((n = pread(STDIN_FILENO, buf.data(), buf.size(), off)) > 0) {
+        h.bytes(buf.data(), n);
+        off += n;
+    }
+}
+
+std::string compute_key(const std::vector<CommandLine> &stages) {
+    Hasher h;
+    h.str("teamshell-memo-v1");
+    for (const auto &cl : stages) {
+        h.u64(cl.argv.size());
+        for (const auto &a : cl.argv) h.str(a);
+        // stderr folded into stdout (or the reverse) is replayed differently
+        h.u64(cl.redirections.size());
+        for (const auto &r : cl.redirections) {
+            h.u64(r.fd);
+            h.u64((uint64_t)(int64_t)r.dup_from);
+            h.str(r.path);
+        }
+    }
+    char cwd[4096] = "";
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+    h.str(cwd);
+    const char *names = getenv("TEAMSHELL_MEMO_ENV");
+    std::string list = names ? names : "PATH:HOME:LANG:LC_ALL";
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(':', start);
+        if (end == std::string::npos) end = list.size();
+        std::string name = list.substr(start, end - start);
+        if (!name.empty()) {
+            const char *v = getenv(name.c_str());
+            h.str(name);
+            h.u64(v != nullptr);
+            if (v) h.str(v);
+        }
+        start = end + 1;
+    }
+    for (const auto &cl : stages) {
+        for (const auto &a : cl.argv) hash_path(h, a);
+        for (const auto &r : cl.redirections)
+            if (r.fd == STDIN_FILENO) hash_path(h, r.path);
+    }
+    if (!stages.empty() && !redirects(stages[0], STDIN_FILENO)) hash_stdin(h);
+    return h.hex();
+}
+
+// replay a cache entry to stdout/stderr; false if missing or corrupt
+bool replay(const std::string &path, int *status) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(EntryHeader)) { close(fd); return false; }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    const char *base = static_cast<const char*>(map);
+    EntryHeader hdr;
+    memcpy(&hdr, base, sizeof(hdr));
+    bool ok = memcmp(hdr.magic, kEntryMagic, sizeof(kEntryMagic)) == 0 &&
+              sizeof(hdr) + hdr.out_len + hdr.err_len == (uint64_t)st.st_size;
+    if (ok) {
+        write_all(STDOUT_FILENO, base + sizeof(hdr), hdr.out_len);
+        write_all(STDERR_FILENO, base + sizeof(hdr) + hdr.out_len, hdr.err_len);
+        *status = hdr.status;
+        // mtime doubles as the LRU timestamp
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    }
+    munmap(map, st.st_size);
+    return ok;
+}
+
+// evict least recently used entries until the cache fits its budget
+void trim_cache(const std::string &dir) {
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+    struct Entry { std::string path; uint64_t size; struct timespec mtime; };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.' || strncmp(de->d_name, "tmp.", 4) == 0) continue;
+        std::string p = dir + "/" + de->d_name;
+        struct stat st;
+        if (stat(p.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        entries.push_back(Entry{p, (uint64_t)st.st_size, st.st_mtim});
+        total += st.st_size;
+    }
+    closedir(d);
+    uint64_t limit = memo_max_bytes();
+    if (total <= limit) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        if (a.mtime.tv_sec != b.mtime.tv_sec) return a.mtime.tv_sec < b.mtime.tv_sec;
+        return a.mtime.tv_nsec < b.mtime.tv_nsec;
+    });
+    uint64_t target = limit - limit / 10;
+    for (const auto &e : entries) {
+        if (total <= target) break;
+        if (unlink(e.path.c_str()) == 0) total -= e.size;
+    }
+}
+
+} // namespace
+
+MemoCommand::MemoCommand(std::unique_ptr<Command> inner, std::vector<CommandLine> stages)
+    : inner_(std::move(inner)), stages_(std::move(stages)) {}
+
+int MemoCommand::execute(bool background) {
+    TraceSpan span("MemoCommand::execute");
+    if (!inner_) { fprintf(stderr, "memo: missing command\n"); return 2; }
+    // output written to files or detached jobs cannot be replayed faithfully,
+    // and what substituted commands or a piped stdin produce is not part of
+    // the key
+    bool cacheable = !background;
+    for (const auto &cl : stages_) {
+        if (!cl.substitutions.empty()) cacheable = false;
+        for (const auto &r : cl.redirections)
+            if (r.fd != STDIN_FILENO && r.dup_from < 0) cacheable = false;
+    }
+    if (!stages_.empty() && !redirects(stages_[0], STDIN_FILENO) && !stdin_keyable()) cacheable = false;
+    std::string dir = memo_dir();
+    if (!cacheable || !ensure_dir(dir)) return inner_->execute(background);
+
+    std::string key = compute_key(stages_);
+    std::string path = dir + "/" + key;
+    span.arg("key", key);
+    int status = 0;
+    if (replay(path, &status)) { span.arg("hit", 1); return status; }
+    span.arg("hit", 0);
+
+    // miss: capture stdout straight into a new entry file, stderr into a scratch file
+    std::string tmp = dir + "/tmp.XXXXXX";
+    std::string errtmp = dir + "/tmp.XXXXXX";
+    int entry_fd = mkstemp(&tmp[0]);
+    int err_fd = mkstemp(&errtmp[0]);
+    if (entry_fd < 0 || err_fd < 0) {
+        perror("memo: mkstemp");
+        if (entry_fd >= 0) { close(entry_fd); unlink(tmp.c_str()); }
+        if (err_fd >= 0) { close(err_fd); unlink(errtmp.c_str()); }
+        return inner_->execute(false);
+    }
+    unlink(errtmp.c_str());
+    EntryHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    lseek(entry_fd, sizeof(hdr), SEEK_SET);
+
+    flush_stdio();
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    int saved_err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(entry_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+    status = inner_->execute(false);
+    flush_stdio();
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    struct stat st_out, st_err;
+    fstat(entry_fd, &st_out);
+    fstat(err_fd, &st_err);
+    memcpy(hdr.magic, kEntryMagic, sizeof(kEntryMagic));
+    hdr.status = status;
+    hdr.out_len = st_out.st_size > (off_t)sizeof(hdr) ? st_out.st_size - sizeof(hdr) : 0;
+    hdr.err_len = st_err.st_size;
+    // only successful runs are stored: a failure or an interrupted run
+    // (Ctrl-C shows up as a nonzero status) must not be replayed later
+    bool store = status == 0;
+    bool ok = store && pwrite(entry_fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+              copy_range(err_fd, 0, hdr.err_len, entry_fd, sizeof(hdr) + hdr.out_len);
+    if (ok && rename(tmp.c_str(), path.c_str()) == 0 && replay(path, &status)) {
+        close(err_fd);
+        close(entry_fd);
+        trim_cache(dir);
+        return status;
+    }
+    // not stored: still show what the command printed
+    if (store) perror("memo: store");
+    copy_range(entry_fd, sizeof(hdr), hdr.out_len, STDOUT_FILENO, -1);
+    copy_range(err_fd, 0, hdr.err_len, STDERR_FILENO, -1);
+    close(err_fd);
+    close(entry_fd);
+    unlink(tmp.c_str());
+    unlink(path.c_str());
+    return status;
+}
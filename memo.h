@@ -0,0 +1,33 @@
+// memo.h - content-addressed output memoization (`memo cmd args...`)
+#ifndef TEAMSHELL_MEMO_H
+#define TEAMSHELL_MEMO_H
+
+#include "command.h"
+#include "parser.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// MemoCommand wraps the Command built for `memo <line>` (simple command,
+// builtin or whole pipeline). The cache key hashes every stage's argv and
+// redirections, the cwd, selected environment variables and the size,
+// mtime and content of files named in argv or < redirections, plus an
+// inherited stdin when it is a regular file (lines read from a pipe or a
+// terminal are not cached; /dev/null is). On a hit the stored stdout, stderr and exit status are
+// replayed without running anything; on a miss the inner command runs with
+// its output captured, and the result is stored only if it exited 0.
+//
+// Cache location: $TEAMSHELL_MEMO_DIR, else ~/.cache/teamshell/memo.
+// Size bound:     $TEAMSHELL_MEMO_MAX_MB (default 256), LRU by entry mtime.
+// Hashed env:     $TEAMSHELL_MEMO_ENV, colon-separated names (default
+//                 PATH:HOME:LANG:LC_ALL).
+class MemoCommand : public Command {
+public:
+    MemoCommand(std::unique_ptr<Command> inner, std::vector<CommandLine> stages);
+    int execute(bool background) override;
+private:
+    std::unique_ptr<Command> inner_;
+    std::vector<CommandLine> stages_;
+};
+
+#endif // TEAMSHELL_MEMO_H
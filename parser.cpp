@@ -1,4 +1,5 @@
 #include "parser.h"
+#include "trace.h"
 #include <cctype>
 
 using namespace std;
@@ -10,7 +11,76 @@ static string trim_copy(const string &s) {
     return s.substr(a, b - a);
 }
 
+// index of the ')' closing a group whose body starts at i (or cmd.size())
+static size_t skip_parens(const string &cmd, size_t i) {
+    int depth = 1;
+    char quote = 0;
+    for (; i < cmd.size(); ++i) {
+        char c = cmd[i];
+        if (quote) { if (c == quote) quote = 0; continue; }
+        if (c == '"' || c == '\'') quote = c;
+        else if (c == '(') depth++;
+        else if (c == ')' && --depth == 0) return i;
+    }
+    return cmd.size();
+}
+
+static bool at_subst(const string &cmd, size_t i) {
+    return i + 1 < cmd.size() && (cmd[i] == '<' || cmd[i] == '>') && cmd[i+1] == '(';
+}
+
+// <(cmd) / >(cmd) at i; returns the index just past it
+static size_t read_subst(const string &cmd, size_t i, ProcessSubst &ps) {
+    ps.output = cmd[i] == '>';
+    size_t close = skip_parens(cmd, i + 2);
+    ps.command = trim_copy(cmd.substr(i + 2, close - i - 2));
+    return close < cmd.size() ? close + 1 : cmd.size();
+}
+
+// >&N / 2>&N at i (just past the '>'); false if there is none
+static bool read_dup(const string &cmd, size_t &i, int fd, CommandLine &cl) {
+    if (i + 1 >= cmd.size() || cmd[i] != '&' || cmd[i+1] < '0' || cmd[i+1] > '2') return false;
+    Redirection r;
+    r.fd = fd;
+    r.dup_from = cmd[i+1] - '0';
+    cl.redirections.push_back(r);
+    i += 2;
+    return true;
+}
+
+// target of redirection r: a file name, or a <(cmd) / >(cmd) whose
+// /dev/fd/N becomes the target once it runs. A missing target is a syntax
+// error, an empty quoted one an open error, as in bash.
+static void read_target(const string &cmd, size_t &i, Redirection r, CommandLine &cl) {
+    const char *p = cmd.c_str();
+    size_t len = cmd.size();
+    while (i < len && isspace((unsigned char)p[i])) i++;
+    if (at_subst(cmd, i)) {
+        ProcessSubst ps;
+        ps.redirect = (int)cl.redirections.size();
+        i = read_subst(cmd, i, ps);
+        cl.substitutions.push_back(ps);
+        cl.redirections.push_back(r);
+        return;
+    }
+    if (i >= len || p[i] == '<' || p[i] == '>' || p[i] == '&') {
+        if (cl.error.empty())
+            cl.error = string("syntax error near unexpected token `") + (i >= len ? string("newline") : string(1, p[i])) + "'";
+        return;
+    }
+    string token;
+    if (p[i] == '"' || p[i] == '\'') {
+        char q = p[i++]; while (i < len && p[i] != q) token.push_back(p[i++]); if (i < len && p[i] == q) i++;
+    } else {
+        while (i < len && !isspace((unsigned char)p[i]) && p[i] != '<' && p[i] != '>' && p[i] != '&') token.push_back(p[i++]);
+    }
+    if (token.empty() && cl.error.empty()) cl.error = ": No such file or directory";
+    r.path = token;
+    cl.redirections.push_back(r);
+}
+
 CommandLine Parser::parse(const string &cmd) {
+    TraceSpan span("Parser::parse");
     CommandLine cl;
     const char *p = cmd.c_str();
     size_t len = cmd.size();
@@ -21,28 +91,33 @@ CommandLine Parser::parse(const string &cmd) {
 
         if (p[i] == '&') { cl.background = true; i++; continue; }
 
-        if (p[i] == '<') {
-            i++; while (i < len && isspace((unsigned char)p[i])) i++;
-            if (i >= len) break;
-            string token;
-            if (p[i] == '"' || p[i] == '\'') {
-                char q = p[i++]; while (i < len && p[i] != q) token.push_back(p[i++]); if (i < len && p[i] == q) i++;
-            } else {
-                while (i < len && !isspace((unsigned char)p[i]) && p[i] != '<' && p[i] != '>' && p[i] != '&') token.push_back(p[i++]);
-            }
-            cl.input_file = token; continue;
+        if (at_subst(cmd, i)) {
+            size_t start = i;
+            ProcessSubst ps;
+            ps.arg = cl.argv.size();
+            i = read_subst(cmd, i, ps);
+            cl.argv.push_back(cmd.substr(start, i - start));
+            cl.substitutions.push_back(ps);
+            continue;
         }
 
-        if (p[i] == '>') {
-            i++; while (i < len && isspace((unsigned char)p[i])) i++;
-            if (i >= len) break;
-            string token;
-            if (p[i] == '"' || p[i] == '\'') {
-                char q = p[i++]; while (i < len && p[i] != q) token.push_back(p[i++]); if (i < len && p[i] == q) i++;
-            } else {
-                while (i < len && !isspace((unsigned char)p[i]) && p[i] != '<' && p[i] != '>' && p[i] != '&') token.push_back(p[i++]);
-            }
-            cl.output_file = token; continue;
+        if ((p[i] == '2' && i + 1 < len && p[i+1] == '>') || p[i] == '>') {
+            Redirection r;
+            r.fd = p[i] == '2' ? 2 : 1;
+            i += r.fd == 2 ? 2 : 1;
+            if (read_dup(cmd, i, r.fd, cl)) continue;
+            r.append = i < len && p[i] == '>';
+            if (r.append) i++;
+            read_target(cmd, i, r, cl);
+            continue;
+        }
+
+        if (p[i] == '<') {
+            i++;
+            Redirection r;
+            r.fd = 0;
+            read_target(cmd, i, r, cl);
+            continue;
         }
 
         string token;
@@ -57,6 +132,7 @@ CommandLine Parser::parse(const string &cmd) {
 }
 
 vector<string> Parser::splitPipeline(const string &cmd) {
+    TraceSpan span("Parser::splitPipeline");
     vector<string> stages;
     string cur;
     char quote = 0;
@@ -68,6 +144,14 @@ vector<string> Parser::splitPipeline(const string &cmd) {
             continue;
         }
         if (c == '"' || c == '\'') { quote = c; cur.push_back(c); continue; }
+        // a process substitution is one word: its pipes belong to it
+        if (at_subst(cmd, i)) {
+            size_t close = skip_parens(cmd, i + 2);
+            size_t end = close < cmd.size() ? close + 1 : cmd.size();
+            cur.append(cmd, i, end - i);
+            i = end - 1;
+            continue;
+        }
         if (c == '|') {
             if (i + 1 < cmd.size() && cmd[i+1] == '|') { cur.push_back(c); continue; }
             string s = trim_copy(cur);
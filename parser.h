@@ -5,11 +5,32 @@
 #include <string>
 #include <vector>
 
+// <(cmd) / >(cmd) word; argv[arg] (or the path of redirections[redirect])
+// is replaced with /dev/fd/N once cmd runs
+struct ProcessSubst {
+    size_t arg = 0;
+    int redirect = -1;   // index of the redirection it is the target of, or -1
+    bool output = false; // >(cmd): the command writes to the pipe, cmd reads it
+    std::string command;
+    int fd = -1;         // the shell's end of the pipe while cmd runs
+};
+
+// <, >, >>, 2>, 2>> (path) or >&N, 2>&N (dup_from); a command's
+// redirections are applied left to right, so `2>&1 > f` leaves stderr
+// where stdout was before f was opened
+struct Redirection {
+    int fd = 0;          // 0, 1 or 2
+    std::string path;
+    int dup_from = -1;   // >= 0: fd becomes a copy of this fd instead
+    bool append = false; // >> instead of >
+};
+
 struct CommandLine {
     std::vector<std::string> argv;
     bool background = false;
-    std::string input_file;
-    std::string output_file;
+    std::vector<Redirection> redirections;
+    std::vector<ProcessSubst> substitutions;
+    std::string error;         // syntax error; the line must not run
 };
 
 class Parser {
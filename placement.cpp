@@ -0,0 +1,336 @@
+// placement.cpp - NUMA-aware stage placement and the taskset builtin
+#include "placement.h"
+#include "builtins.h"
+#include "command.h"
+#include "runtime_state.h"
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+static const int kIoprioClassShift = 13;
+static const int kIoprioWhoProcess = 1;
+
+bool parse_cpu_list(const std::string &s, std::vector<int> &cpus) {
+    cpus.clear();
+    size_t start = 0;
+    while (start < s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        std::string part = s.substr(start, end - start);
+        char *rest = nullptr;
+        long a = strtol(part.c_str(), &rest, 10);
+        long b = a;
+        if (rest == part.c_str() || a < 0) return false;
+        if (*rest == '-') {
+            const char *bs = rest + 1;
+            b = strtol(bs, &rest, 10);
+            if (rest == bs || b < a) return false;
+        }
+        if (*rest != '\0') return false;
+        for (long c = a; c <= b && c < CPU_SETSIZE; ++c) cpus.push_back((int)c);
+        start = end + 1;
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
+
+static std::vector<int> allowed_cpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int c = 0; c < CPU_SETSIZE; ++c) if (CPU_ISSET(c, &set)) cpus.push_back(c);
+    return cpus;
+}
+
+int allowed_cpu_count() {
+    size_t n = allowed_cpus().size();
+    if (n == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        return online > 0 ? (int)online : 1;
+    }
+    return (int)n;
+}
+
+// NUMA nodes as lists of allowed cpus; one pseudo-node when sysfs has none
+static std::vector<std::vector<int>> numa_nodes() {
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<std::vector<int>> nodes;
+    DIR *d = opendir("/sys/devices/system/node");
+    if (d) {
+        std::vector<int> ids;
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (strncmp(de->d_name, "node", 4) == 0 && isdigit((unsigned char)de->d_name[4]))
+                ids.push_back(atoi(de->d_name + 4));
+        }
+        closedir(d);
+        std::sort(ids.begin(), ids.end());
+        for (int id : ids) {
+            std::ifstream f("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string line;
+            std::vector<int> cpus, usable;
+            if (!std::getline(f, line) || !parse_cpu_list(line, cpus)) continue;
+            for (int c : cpus)
+                if (std::binary_search(allowed.begin(), allowed.end(), c)) usable.push_back(c);
+            if (!usable.empty()) nodes.push_back(usable);
+        }
+    }
+    if (nodes.empty() && !allowed.empty()) nodes.push_back(allowed);
+    return nodes;
+}
+
+std::vector<StagePlacement> PlacementPolicy::plan(int nstages) const {
+    std::vector<StagePlacement> out(nstages);
+    for (int i = 0; i < nstages; ++i) {
+        StagePlacement &p = out[i];
+        if (!nice.empty()) { p.set_nice = true; p.nice = nice[std::min<size_t>(i, nice.size() - 1)]; }
+        if (!ioprio.empty()) p.ioprio = ioprio[std::min<size_t>(i, ioprio.size() - 1)];
+    }
+    if (mode == None) return out;
+    auto nodes = numa_nodes();
+    if (nodes.empty()) return out;
+    // locate the node (and position in it) of the cpu the shell is running on
+    int cur = sched_getcpu();
+    size_t home = 0, pos = 0;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        auto it = std::find(nodes[n].begin(), nodes[n].end(), cur);
+        if (it != nodes[n].end()) { home = n; pos = it - nodes[n].begin(); break; }
+    }
+    // adjacent order: the home node starting at the current cpu, then the other nodes
+    std::vector<int> order;
+    for (size_t k = 0; k < nodes[home].size(); ++k) order.push_back(nodes[home][(pos + k) % nodes[home].size()]);
+    for (size_t n = 1; n < nodes.size(); ++n)
+        for (int c : nodes[(home + n) % nodes.size()]) order.push_back(c);
+    for (int i = 0; i < nstages; ++i) {
+        if (mode == SameNode) out[i].cpus = nodes[home];
+        else if (mode == Spread) out[i].cpus = nodes[(home + i) % nodes.size()];
+        else out[i].cpus.push_back(order[i % order.size()]);
+    }
+    return out;
+}
+
+static bool parse_int_list(const std::string &s, std::vector<int> &out) {
+    out.clear();
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        std::string part = s.substr(start, end - start);
+        char *rest = nullptr;
+        long v = strtol(part.c_str(), &rest, 10);
+        if (part.empty() || *rest != '\0') return false;
+        out.push_back((int)v);
+        start = end + 1;
+    }
+    return !out.empty();
+}
+
+// CLASS[:LEVEL] with CLASS one of rt, be, idle (or 1-3)
+static bool parse_ioprio_list(const std::string &s, std::vector<int> &out) {
+    out.clear();
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        std::string part = s.substr(start, end - start);
+        std::string cls = part, lvl = "4";
+        size_t colon = part.find(':');
+        if (colon != std::string::npos) { cls = part.substr(0, colon); lvl = part.substr(colon + 1); }
+        int c;
+        if (cls == "rt" || cls == "1") c = 1;
+        else if (cls == "be" || cls == "2") c = 2;
+        else if (cls == "idle" || cls == "3") c = 3;
+        else return false;
+        char *rest = nullptr;
+        long l = strtol(lvl.c_str(), &rest, 10);
+        if (*rest != '\0' || l < 0 || l > 7) return false;
+        out.push_back((c << kIoprioClassShift) | (c == 3 ? 0 : (int)l));
+        start = end + 1;
+    }
+    return !out.empty();
+}
+
+bool parse_placement_args(std::vector<std::string> &argv, PlacementPolicy &policy) {
+    size_t i = 1; // argv[0] is "place"
+    while (i < argv.size() && argv[i].size() > 1 && argv[i][0] == '-') {
+        const std::string &opt = argv[i];
+        if (opt == "--") { ++i; break; }
+        if (i + 1 >= argv.size()) { fprintf(stderr, "place: option %s requires an argument\n", opt.c_str()); return false; }
+        const std::string &val = argv[i + 1];
+        if (opt == "-p") {
+            if (val == "adjacent") policy.mode = PlacementPolicy::Adjacent;
+            else if (val == "node") policy.mode = PlacementPolicy::SameNode;
+            else if (val == "spread" || val == "rr") policy.mode = PlacementPolicy::Spread;
+            else if (val == "none") policy.mode = PlacementPolicy::None;
+            else { fprintf(stderr, "place: unknown policy '%s'\n", val.c_str()); return false; }
+        } else if (opt == "-n") {
+            if (!parse_int_list(val, policy.nice)) { fprintf(stderr, "place: bad nice list '%s'\n", val.c_str()); return false; }
+        } else if (opt == "-i") {
+            if (!parse_ioprio_list(val, policy.ioprio)) { fprintf(stderr, "place: bad ioprio list '%s'\n", val.c_str()); return false; }
+        } else {
+            fprintf(stderr, "place: unknown option %s\n", opt.c_str());
+            return false;
+        }
+        i += 2;
+    }
+    argv.erase(argv.begin(), argv.begin() + i);
+    if (argv.empty()) {
+        fprintf(stderr, "usage: place [-p adjacent|node|spread] [-n NICE[,..]] [-i CLASS[:LEVEL][,..]] [--] command [| command...]\n");
+        return false;
+    }
+    return true;
+}
+
+void apply_stage_placement(const StagePlacement &p) {
+    if (!p.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : p.cpus) CPU_SET(c, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) perror("place: sched_setaffinity");
+    }
+    if (p.set_nice && setpriority(PRIO_PROCESS, 0, p.nice) != 0) perror("place: setpriority");
+    if (p.ioprio >= 0 && syscall(SYS_ioprio_set, kIoprioWhoProcess, 0, p.ioprio) != 0) perror("place: ioprio_set");
+}
+
+// ---- taskset builtin ---------------------------------------------------
+
+static bool parse_hex_mask(std::string s, std::vector<int> &cpus) {
+    cpus.clear();
+    if (s.compare(0, 2, "0x") == 0 || s.compare(0, 2, "0X") == 0) s = s.substr(2);
+    if (s.empty()) return false;
+    int bit = 0;
+    for (size_t k = s.size(); k-- > 0;) {
+        char ch = s[k];
+        int v;
+        if (ch >= '0' && ch <= '9') v = ch - '0';
+        else if (ch >= 'a' && ch <= 'f') v = ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') v = ch - 'A' + 10;
+        else if (ch == ',') continue;
+        else return false;
+        for (int b = 0; b < 4; ++b) if ((v >> b) & 1) cpus.push_back(bit + b);
+        bit += 4;
+    }
+    std::sort(cpus.begin(), cpus.end());
+    return !cpus.empty();
+}
+
+static std::string format_mask(const cpu_set_t &set) {
+    std::string hex;
+    int top = -1;
+    for (int c = 0; c < CPU_SETSIZE; ++c) if (CPU_ISSET(c, &set)) top = c;
+    if (top < 0) return "0";
+    for (int base = (top / 4) * 4; base >= 0; base -= 4) {
+        int v = 0;
+        for (int b = 0; b < 4; ++b) if (CPU_ISSET(base + b, &set)) v |= 1 << b;
+        hex.push_back("0123456789abcdef"[v]);
+    }
+    return hex;
+}
+
+static std::string format_list(const cpu_set_t &set) {
+    std::string out;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (!CPU_ISSET(c, &set)) continue;
+        int e = c;
+        while (e + 1 < CPU_SETSIZE && CPU_ISSET(e + 1, &set)) ++e;
+        if (!out.empty()) out += ",";
+        out += std::to_string(c);
+        if (e > c) out += "-" + std::to_string(e);
+        c = e;
+    }
+    return out;
+}
+
+static void print_affinity(pid_t pid, const char *which, bool as_list) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(pid, sizeof(set), &set) != 0) { perror("taskset"); return; }
+    printf("pid %d's %s affinity %s: %s\n", (int)pid, which, as_list ? "list" : "mask",
+           as_list ? format_list(set).c_str() : format_mask(set).c_str());
+}
+
+// taskset [-c] MASK|LIST command [args...]
+// taskset -p [-c] [MASK|LIST] PID
+int taskset_builtin(const CommandLine &cl) {
+    bool as_list = false, pid_mode = false;
+    size_t i = 1;
+    for (; i < cl.argv.size() && cl.argv[i].size() > 1 && cl.argv[i][0] == '-'; ++i) {
+        const std::string &a = cl.argv[i];
+        if (a == "--") { ++i; break; }
+        for (size_t k = 1; k < a.size(); ++k) {
+            if (a[k] == 'c') as_list = true;
+            else if (a[k] == 'p') pid_mode = true;
+            else { fprintf(stderr, "taskset: invalid option -- '%c'\n", a[k]); return 1; }
+        }
+    }
+    std::vector<std::string> rest(cl.argv.begin() + i, cl.argv.end());
+    if (rest.empty() || (!pid_mode && rest.size() < 2)) {
+        fprintf(stderr, "usage: taskset [-c] mask command [args...] | taskset -p [-c] [mask] pid\n");
+        return 1;
+    }
+    std::vector<int> cpus;
+    if (pid_mode) {
+        // 0 would mean the shell itself
+        const std::string &arg = rest.back();
+        char *end = nullptr;
+        errno = 0;
+        long v = strtol(arg.c_str(), &end, 10);
+        if (arg.empty() || *end != '\0' || errno != 0 || v <= 0 || v != (pid_t)v) {
+            fprintf(stderr, "taskset: invalid PID argument: '%s'\n", arg.c_str());
+            return 1;
+        }
+        pid_t pid = (pid_t)v;
+        print_affinity(pid, "current", as_list);
+        if (rest.size() == 1) return 0;
+        if (!(as_list ? parse_cpu_list(rest[0], cpus) : parse_hex_mask(rest[0], cpus))) {
+            fprintf(stderr, "taskset: failed to parse CPU %s: %s\n", as_list ? "list" : "mask", rest[0].c_str());
+            return 1;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : cpus) if (c < CPU_SETSIZE) CPU_SET(c, &set);
+        if (sched_setaffinity(pid, sizeof(set), &set) != 0) { perror("taskset"); return 1; }
+        print_affinity(pid, "new", as_list);
+        return 0;
+    }
+    if (!(as_list ? parse_cpu_list(rest[0], cpus) : parse_hex_mask(rest[0], cpus))) {
+        fprintf(stderr, "taskset: failed to parse CPU %s: %s\n", as_list ? "list" : "mask", rest[0].c_str());
+        return 1;
+    }
+    CommandLine sub = cl;
+    sub.argv.assign(rest.begin() + 1, rest.end());
+    // the caller already applied the redirections; the child inherits them
+    sub.redirections.clear();
+    StagePlacement p;
+    p.cpus = cpus;
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return 1; }
+    if (pid == 0) {
+        setpgid(0, 0);
+        apply_stage_placement(p);
+        exec_command_line(sub);
+    }
+    setpgid(pid, pid);
+    if (cl.background) {
+        printf("[Background] %d\n", (int)pid);
+        return 0;
+    }
+    fg_pgid = (sig_atomic_t)pid;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    fg_pgid = 0;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,47 @@
+// placement.h - CPU affinity, nice and I/O priority for pipeline stages
+#ifndef TEAMSHELL_PLACEMENT_H
+#define TEAMSHELL_PLACEMENT_H
+
+#include "parser.h"
+#include <string>
+#include <vector>
+
+// Scheduling settings applied in one child right before exec.
+struct StagePlacement {
+    std::vector<int> cpus;   // empty = inherit affinity
+    bool set_nice = false;
+    int nice = 0;
+    int ioprio = -1;         // encoded ioprio_set value, -1 = inherit
+    bool empty() const { return cpus.empty() && !set_nice && ioprio < 0; }
+};
+
+// Per-pipeline policy set with the `place` prefix:
+//   place [-p adjacent|node|spread] [-n NICE[,NICE...]] [-i CLASS[:LEVEL][,...]] [--] pipeline
+// adjacent: stage i is pinned to the i-th core counting from the shell's
+//           current core, walking its NUMA node first
+// node:     every stage may run on any core of the shell's current node
+// spread:   stage i gets all cores of NUMA node i % nodes (round-robin)
+// Comma lists give per-stage values; the last one repeats for later stages.
+struct PlacementPolicy {
+    enum Mode { None, Adjacent, SameNode, Spread };
+    Mode mode = None;
+    std::vector<int> nice;
+    std::vector<int> ioprio;
+    // resolve the policy against the current topology for n stages
+    std::vector<StagePlacement> plan(int nstages) const;
+};
+
+// strip "place" and its options from the front of argv; false on bad usage
+bool parse_placement_args(std::vector<std::string> &argv, PlacementPolicy &policy);
+
+// called in the child; failures are reported but not fatal
+void apply_stage_placement(const StagePlacement &p);
+
+// number of cpus in the calling thread's affinity mask (at least 1);
+// the default worker count for multi-threaded builtins
+int allowed_cpu_count();
+
+// parse a cpu list such as "0-3,8,10-11"; false on syntax error
+bool parse_cpu_list(const std::string &s, std::vector<int> &cpus);
+
+#endif // TEAMSHELL_PLACEMENT_H
@@ -0,0 +1,65 @@
+// procsub.cpp - process substitution children and their pipes
+#include "procsub.h"
+#include "trace.h"
+#include "zygote.h"
+#include "fd_io.h"
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+
+bool ProcessSubstitution::start(std::vector<CommandLine> &cmds, const LineRunner &run) {
+    TraceSpan span("procsub");
+    flush_stdio();
+    for (auto &cl : cmds) {
+        for (auto &ps : cl.substitutions) {
+            int pipefd[2];
+            if (pipe2(pipefd, O_CLOEXEC) < 0) { perror("pipe"); return false; }
+            // <(cmd): cmd writes, the line reads; >(cmd): the reverse
+            int mine = ps.output ? pipefd[1] : pipefd[0];
+            int theirs = ps.output ? pipefd[0] : pipefd[1];
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                close(mine);
+                close(theirs);
+                return false;
+            }
+            if (pid == 0) {
+                Zygote::release();
+                dup2(theirs, ps.output ? STDIN_FILENO : STDOUT_FILENO);
+                close(theirs);
+                close(mine);
+                for (int fd : fds_) close(fd);
+                int rc = run(ps.command);
+                flush_stdio();
+                Tracer::flushBeforeExit();
+                _exit(rc & 0xff);
+            }
+            close(theirs);
+            fds_.push_back(mine);
+            pids_.push_back(pid);
+            ps.fd = mine;
+            std::string path = "/dev/fd/" + std::to_string(mine);
+            if (ps.redirect >= 0) cl.redirections[ps.redirect].path = path;
+            else cl.argv[ps.arg] = path;
+        }
+    }
+    span.arg("count", (long long)pids_.size());
+    return true;
+}
+
+void ProcessSubstitution::finish() {
+    // closing our ends gives >(cmd) its EOF and <(cmd) a SIGPIPE if unread
+    for (int fd : fds_) close(fd);
+    fds_.clear();
+    if (wait_) {
+        for (pid_t pid : pids_) {
+            TraceSpan wait_span("waitpid");
+            wait_span.arg("pid", pid);
+            while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+        }
+    }
+    pids_.clear();
+}
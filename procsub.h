@@ -0,0 +1,37 @@
+// procsub.h - process substitution: <(cmd) and >(cmd) as /dev/fd/N pipes
+#ifndef TEAMSHELL_PROCSUB_H
+#define TEAMSHELL_PROCSUB_H
+
+#include "parser.h"
+#include <sys/types.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Starts the command behind every <(...) / >(...) word of a parsed line in
+// a forked copy of the shell, connected by a pipe whose other end stays in
+// the shell and replaces the word (or redirection target) as /dev/fd/N.
+// The shell's ends are close-on-exec; exec_command_line clears the flag
+// only for the stage that names them, so no other process keeps a pipe
+// open. Destruction closes the ends and reaps the producers along with
+// the line.
+class ProcessSubstitution {
+public:
+    // runs one command line in the substitution child, returning its status
+    typedef std::function<int(const std::string &)> LineRunner;
+    ProcessSubstitution() = default;
+    ProcessSubstitution(const ProcessSubstitution &) = delete;
+    ProcessSubstitution &operator=(const ProcessSubstitution &) = delete;
+    ~ProcessSubstitution() { finish(); }
+    // false (with a message) if a pipe or fork failed
+    bool start(std::vector<CommandLine> &cmds, const LineRunner &run);
+    // the line went to the background: close our ends but do not wait
+    void detach() { wait_ = false; }
+    void finish();
+private:
+    std::vector<int> fds_;
+    std::vector<pid_t> pids_;
+    bool wait_ = true;
+};
+
+#endif // TEAMSHELL_PROCSUB_H
@@ -0,0 +1,75 @@
+// redirect.cpp - redirection of the standard fds
+#include "redirect.h"
+#include "trace.h"
+#include "fd_io.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+
+static bool redirect_to(const std::string &path, int flags, int target, const char *what) {
+    int fd = open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0) { perror(what); return false; }
+    if (fd != target) {
+        // dup2 clears close-on-exec on the copy
+        dup2(fd, target);
+        close(fd);
+    } else {
+        fcntl(fd, F_SETFD, 0);
+    }
+    return true;
+}
+
+bool has_redirections(const CommandLine &cl) {
+    return !cl.redirections.empty();
+}
+
+bool redirects(const CommandLine &cl, int fd) {
+    for (const auto &r : cl.redirections) if (r.fd == fd) return true;
+    return false;
+}
+
+bool apply_redirections(const CommandLine &cl) {
+    static const char *const what[3] = { "open input", "open output", "open error" };
+    for (const auto &r : cl.redirections) {
+        if (r.dup_from >= 0) {
+            if (r.dup_from != r.fd && dup2(r.dup_from, r.fd) < 0) { perror("redirect"); return false; }
+            continue;
+        }
+        int flags = r.fd == STDIN_FILENO ? O_RDONLY : O_WRONLY | O_CREAT | (r.append ? O_APPEND : O_TRUNC);
+        if (!redirect_to(r.path, flags, r.fd, what[r.fd])) return false;
+    }
+    return true;
+}
+
+bool RedirectGuard::apply(const CommandLine &cl) {
+    if (!has_redirections(cl)) return true;
+    TraceSpan span("redirect");
+    bool change[3] = { redirects(cl, 0), redirects(cl, 1), redirects(cl, 2) };
+    flush_stdio();
+    for (int fd = 0; fd < 3; ++fd) {
+        if (!change[fd]) continue;
+        // keep the saved copies away from the low fds builtins may open
+        saved_[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+        if (saved_[fd] < 0) {
+            perror("redirect: save fd");
+            restore();
+            return false;
+        }
+    }
+    if (!apply_redirections(cl)) {
+        restore();
+        return false;
+    }
+    return true;
+}
+
+void RedirectGuard::restore() {
+    if (saved_[0] < 0 && saved_[1] < 0 && saved_[2] < 0) return;
+    flush_stdio();
+    for (int fd = 0; fd < 3; ++fd) {
+        if (saved_[fd] < 0) continue;
+        dup2(saved_[fd], fd);
+        close(saved_[fd]);
+        saved_[fd] = -1;
+    }
+}
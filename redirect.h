@@ -0,0 +1,35 @@
+// redirect.h - <, >, >>, 2>, >&N, 2>&N for children and for builtins run in-process
+#ifndef TEAMSHELL_REDIRECT_H
+#define TEAMSHELL_REDIRECT_H
+
+#include "parser.h"
+
+// apply cl's redirections left to right: open each target (or take the
+// copy of another fd) and dup2 it over fd 0, 1 or 2; on failure the error
+// is reported and false returned, and fds already replaced stay replaced
+bool apply_redirections(const CommandLine &cl);
+
+// true if cl redirects any of stdin, stdout or stderr
+bool has_redirections(const CommandLine &cl);
+
+// true if cl redirects fd
+bool redirects(const CommandLine &cl, int fd);
+
+// Applies a builtin's redirections to the shell process itself for the
+// guard's lifetime, so redirected builtins need no fork. The affected
+// fds are first saved with F_DUPFD_CLOEXEC; stdio is flushed before the
+// switch and again before the originals are restored.
+class RedirectGuard {
+public:
+    RedirectGuard() = default;
+    RedirectGuard(const RedirectGuard &) = delete;
+    RedirectGuard &operator=(const RedirectGuard &) = delete;
+    ~RedirectGuard() { restore(); }
+    // false (reported, nothing left applied) if a target could not be opened
+    bool apply(const CommandLine &cl);
+    void restore();
+private:
+    int saved_[3] = {-1, -1, -1};
+};
+
+#endif // TEAMSHELL_REDIRECT_H
@@ -2,3 +2,4 @@
 #include "runtime_state.h"
 
 volatile sig_atomic_t fg_pgid = 0;
+volatile sig_atomic_t interrupted = 0;
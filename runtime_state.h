@@ -5,5 +5,9 @@
 #include <signal.h>
 
 extern volatile sig_atomic_t fg_pgid;
+// set by the shell's SIGINT handler when there is no foreground job to
+// forward it to; long-running builtins that execute inside the shell
+// (sort, hashsum) clear it on entry, poll it and return 130 once it is set
+extern volatile sig_atomic_t interrupted;
 
 #endif // TEAMSHELL_RUNTIME_STATE_H
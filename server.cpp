@@ -0,0 +1,264 @@
+// server.cpp - Unix socket server and thin client for teamshell
+#include "server.h"
+#include "trace.h"
+#include "runtime_state.h"
+#include "fd_io.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+extern char **environ;
+
+static bool fill_sockaddr(const std::string &path, struct sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "teamshell: socket path too long: %s\n", path.c_str());
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// upper bounds on a request's variable-length parts
+static const uint32_t kMaxCwdBytes = 4096;
+static const uint32_t kMaxEnvBytes = 4u << 20;
+static const uint32_t kMaxScriptBytes = 64u << 20;
+
+// connection of the request being served, for the status on `exit`
+static int g_request_conn = -1;
+
+// a script line ran `exit`: the process ends through exit(), so report
+// success to the client from here
+static void send_exit_status() {
+    if (g_request_conn < 0) return;
+    int32_t status = 0;
+    send_all(g_request_conn, &status, sizeof(status));
+}
+
+// SIGCHLD only wakes the accept loop's poll(); children are reaped there
+static void wake_on_child(int) {}
+
+// the client went away: stop its foreground job, then the request itself
+static void hangup_request(int sig) {
+    if (fg_pgid != 0) kill(-(pid_t)fg_pgid, sig);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+ShellServer::ShellServer(const std::string &socket_path) : socket_path_(socket_path) {}
+
+int ShellServer::run() {
+    struct sockaddr_un addr;
+    if (!fill_sockaddr(socket_path_, addr)) return 1;
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) { perror("socket"); return 1; }
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); return 1; }
+    // requests run as us: keep other users off the socket
+    if (chmod(socket_path_.c_str(), 0600) < 0) { perror("chmod"); return 1; }
+    if (listen(listen_fd_, 128) < 0) { perror("listen"); return 1; }
+
+    // the server itself is not interactive: let ^C stop it; a finished
+    // request interrupts poll() so its connection is released
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = wake_on_child;
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, nullptr);
+    fprintf(stderr, "teamshell: listening on %s\n", socket_path_.c_str());
+
+    // Each request runs in its own process group. The server keeps its copy
+    // of the connection and watches it for the client hanging up; the group
+    // is then sent SIGHUP so nothing keeps writing to the client's terminal.
+    // A request is reaped only here, so its pgid cannot be reused while its
+    // connection is still being watched.
+    struct Request { pid_t pid; int conn; };
+    std::vector<Request> active;
+    while (true) {
+        int st;
+        pid_t r;
+        while ((r = waitpid(-1, &st, WNOHANG)) > 0) {
+            for (size_t k = 0; k < active.size(); ++k) {
+                if (active[k].pid != r) continue;
+                if (active[k].conn >= 0) close(active[k].conn);
+                active.erase(active.begin() + k);
+                break;
+            }
+        }
+        std::vector<struct pollfd> pfds;
+        pfds.push_back({listen_fd_, POLLIN, 0});
+        for (const auto &req : active) pfds.push_back({req.conn, POLLRDHUP, 0});
+        if (poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+        for (size_t k = 1; k < pfds.size(); ++k) {
+            Request &req = active[k - 1];
+            if (req.conn < 0 || !(pfds[k].revents & (POLLRDHUP | POLLHUP | POLLERR))) continue;
+            kill(-req.pid, SIGHUP);
+            close(req.conn);
+            req.conn = -1;
+        }
+        // hung-up requests stay listed (with no connection) until reaped
+        if (!(pfds[0].revents & POLLIN)) continue;
+        int conn = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED) continue;
+            perror("accept");
+            return 1;
+        }
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != geteuid()) {
+            fprintf(stderr, "teamshell: rejected connection from uid %d\n", cred_len == sizeof(cred) ? (int)cred.uid : -1);
+            close(conn);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); close(conn); continue; }
+        if (pid == 0) {
+            setpgid(0, 0);
+            close(listen_fd_);
+            for (const auto &req : active) if (req.conn >= 0) close(req.conn);
+            // commands run by this request wait for their own children
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGHUP, hangup_request);
+            serveClient(conn);
+            Tracer::flushBeforeExit();
+            _exit(0);
+        }
+        setpgid(pid, pid);
+        active.push_back({pid, conn});
+    }
+}
+
+void ShellServer::serveClient(int conn) {
+    RequestHeader hdr;
+    struct iovec iov = { &hdr, sizeof(hdr) };
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    if (n != (ssize_t)sizeof(hdr) || hdr.magic != kServerMagic) {
+        fprintf(stderr, "teamshell: malformed request\n");
+        return;
+    }
+    int fds[3] = {-1, -1, -1};
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS &&
+            c->cmsg_len == CMSG_LEN(3 * sizeof(int)))
+            memcpy(fds, CMSG_DATA(c), sizeof(fds));
+    }
+    if (hdr.cwd_len > kMaxCwdBytes || hdr.env_len > kMaxEnvBytes || hdr.script_len > kMaxScriptBytes) {
+        fprintf(stderr, "teamshell: oversized request\n");
+        return;
+    }
+    std::string cwd(hdr.cwd_len, '\0'), env(hdr.env_len, '\0'), script(hdr.script_len, '\0');
+    if (!read_all(conn, &cwd[0], cwd.size()) || !read_all(conn, &env[0], env.size()) ||
+        !read_all(conn, &script[0], script.size())) {
+        fprintf(stderr, "teamshell: truncated request\n");
+        return;
+    }
+
+    // adopt the client's stdio, cwd and environment
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] < 0) continue;
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    if (!cwd.empty() && chdir(cwd.c_str()) != 0) perror("chdir");
+    clearenv();
+    size_t start = 0;
+    while (start < env.size()) {
+        size_t end = env.find('\0', start);
+        if (end == std::string::npos) end = env.size();
+        std::string kv = env.substr(start, end - start);
+        size_t eq = kv.find('=');
+        if (eq != std::string::npos) setenv(kv.substr(0, eq).c_str(), kv.substr(eq + 1).c_str(), 1);
+        start = end + 1;
+    }
+
+    g_request_conn = conn;
+    atexit(send_exit_status);
+    std::istringstream in(script);
+    std::string line;
+    while (std::getline(in, line)) shell_.handleLine(line);
+    flush_stdio();
+    int32_t status = shell_.lastStatus();
+    send_all(conn, &status, sizeof(status));
+    g_request_conn = -1;
+    close(conn);
+}
+
+int run_server_client(const std::string &socket_path, const std::string &script) {
+    struct sockaddr_un addr;
+    if (!fill_sockaddr(socket_path, addr)) return 127;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("socket"); return 127; }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror(("teamshell: " + socket_path).c_str());
+        close(fd);
+        return 127;
+    }
+    char cwd[4096] = "";
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+    std::string env;
+    for (char **e = environ; e && *e; ++e) { env += *e; env.push_back('\0'); }
+
+    RequestHeader hdr;
+    hdr.magic = kServerMagic;
+    hdr.cwd_len = strlen(cwd);
+    hdr.env_len = env.size();
+    hdr.script_len = script.size();
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    struct iovec iov = { &hdr, sizeof(hdr) };
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hdr) ||
+        !send_all(fd, cwd, hdr.cwd_len) || !send_all(fd, env.data(), env.size()) ||
+        !send_all(fd, script.data(), script.size())) {
+        perror("teamshell: send");
+        close(fd);
+        return 127;
+    }
+    int32_t status = 0;
+    if (!read_all(fd, &status, sizeof(status))) {
+        fprintf(stderr, "teamshell: server closed the connection without a status\n");
+        status = 255;
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,42 @@
+// server.h - persistent server mode over a Unix domain socket
+#ifndef TEAMSHELL_SERVER_H
+#define TEAMSHELL_SERVER_H
+
+#include "shell.h"
+#include <cstdint>
+#include <string>
+
+// Wire protocol (one request per connection):
+//   client -> server: RequestHeader sent with SCM_RIGHTS carrying the
+//                     client's stdin, stdout and stderr, followed by
+//                     cwd_len bytes of cwd, env_len bytes of NUL-separated
+//                     KEY=VALUE pairs and script_len bytes of script text.
+//   server -> client: int32_t exit status of the last executed line.
+struct RequestHeader {
+    uint32_t magic;
+    uint32_t cwd_len;
+    uint32_t env_len;
+    uint32_t script_len;
+};
+
+static const uint32_t kServerMagic = 0x54534831; // "TSH1"
+
+// Accepts connections on a Unix socket and runs each request in a forked
+// child of the already-initialized server process, so clients skip
+// exec, dynamic linking and shell setup.
+class ShellServer {
+public:
+    explicit ShellServer(const std::string &socket_path);
+    int run();
+private:
+    void serveClient(int conn);
+    std::string socket_path_;
+    int listen_fd_ = -1;
+    Shell shell_;
+};
+
+// Thin client: send script with our cwd/env/stdio to the server and
+// return the remote exit status (or 127 if the server is unreachable).
+int run_server_client(const std::string &socket_path, const std::string &script);
+
+#endif // TEAMSHELL_SERVER_H
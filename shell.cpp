@@ -2,6 +2,8 @@
 #include "shell.h"
 #include "parser.h"
 #include "command_factory.h"
+#include "procsub.h"
+#include "redirect.h"
 #include <vector>
 #include <string>
 #include <unistd.h>
@@ -11,11 +13,13 @@
 #include <glob.h>
 #include <cstring>
 #include <iostream>
+#include <set>
 // readline for interactive prompt
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <signal.h>
 #include "runtime_state.h"
+#include "trace.h"
 
 // forward declare signal handlers so constructor can register them
 static void sigint_handler(int);
@@ -23,10 +27,19 @@ static void sigtstp_handler(int);
 static void sigquit_handler(int);
 
 Shell::Shell() {
-    // register signal handlers to forward to foreground process group
-    signal(SIGINT, sigint_handler);
+    // register signal handlers to forward to foreground process group;
+    // SIGINT does not restart system calls, so a builtin blocked reading a
+    // terminal or pipe sees EINTR and can check `interrupted`
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigint_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
     signal(SIGTSTP, sigtstp_handler);
     signal(SIGQUIT, sigquit_handler);
+    // TEAMSHELL_TRACE=<file> enables hot-path tracing from startup
+    const char *trace_path = getenv("TEAMSHELL_TRACE");
+    if (trace_path && trace_path[0] != '\0') Tracer::instance().enable(trace_path);
 }
 
 int Shell::runNonInteractive(std::istream &in) {
@@ -62,6 +75,8 @@ static void sigint_handler(int sig) {
     (void)sig;
     if (fg_pgid != 0) {
         kill(- (pid_t)fg_pgid, SIGINT);
+    } else {
+        interrupted = 1;
     }
 }
 
@@ -79,19 +94,60 @@ static void sigquit_handler(int sig) {
     }
 }
 
+// set -o/+o: toggle shell options; currently only "trace"
+static int set_builtin(const std::vector<std::string> &argv) {
+    if (argv.size() < 2 || (argv[1] == "-o" && argv.size() == 2)) {
+        printf("trace\t%s\n", Tracer::enabled() ? "on" : "off");
+        return 0;
+    }
+    if (argv.size() < 3 || (argv[1] != "-o" && argv[1] != "+o")) {
+        fprintf(stderr, "set: usage: set -o trace [file] | set +o trace\n");
+        return 2;
+    }
+    if (argv[2] != "trace") {
+        fprintf(stderr, "set: %s: invalid option name\n", argv[2].c_str());
+        return 2;
+    }
+    if (argv[1] == "+o") { Tracer::instance().disable(); return 0; }
+    std::string path = argv.size() >= 4 ? argv[3] : "teamshell-trace.json";
+    if (!Tracer::instance().enable(path)) return 1;
+    fprintf(stderr, "trace: writing to %s\n", path.c_str());
+    return 0;
+}
+
+// builtins handleLine runs in the shell process itself
+static const std::set<std::string> kParentBuiltins = {
+    "cd", "set", "pwd", "ls", "grep", "cp", "mv", "rm", "ln", "mkdir", "rmdir", "cat",
+};
+
 // execute_pipeline removed: command execution is handled by Command objects
 
 void Shell::handleLine(const std::string &line) {
+    TraceSpan span("handleLine");
+    span.arg("line", line);
     try {
         auto stage_strs = parser_.splitPipeline(line);
         if (stage_strs.empty()) return;
         std::vector<CommandLine> cmds;
         for (const auto &s: stage_strs) cmds.push_back(parser_.parse(s));
+        for (const auto &cl : cmds) {
+            if (cl.error.empty()) continue;
+            fprintf(stderr, "teamshell: %s\n", cl.error.c_str());
+            last_status_ = 2;
+            return;
+        }
 
     // Parent-side globbing: expand wildcard args before execution
+    {
+    TraceSpan glob_span("glob");
     for (auto &cl : cmds) {
         std::vector<std::string> newargv;
-        for (const auto &a : cl.argv) {
+        // process substitution words are not patterns; track where they move
+        std::vector<size_t> moved(cl.argv.size(), (size_t)-1);
+        for (const auto &ps : cl.substitutions) if (ps.redirect == -1) moved[ps.arg] = 0;
+        for (size_t ai = 0; ai < cl.argv.size(); ++ai) {
+            const auto &a = cl.argv[ai];
+            if (moved[ai] != (size_t)-1) { moved[ai] = newargv.size(); newargv.push_back(a); continue; }
             bool has_wild = (a.find_first_of("*?[") != std::string::npos);
             if (!has_wild) { newargv.push_back(a); continue; }
             glob_t g; memset(&g, 0, sizeof(g));
@@ -105,72 +161,97 @@ void Shell::handleLine(const std::string &line) {
             }
         }
         cl.argv.swap(newargv);
+        for (auto &ps : cl.substitutions) if (ps.redirect == -1) ps.arg = moved[ps.arg];
+    }
     }
 
         // Determine if any stage requested background execution
         bool background = false;
         for (const auto &cl : cmds) if (cl.background) background = true;
 
+        // start <(...) / >(...) producers; they are reaped when this returns
+        ProcessSubstitution subst;
+        if (background) subst.detach();
+        if (!subst.start(cmds, [this](const std::string &sub) { handleLine(sub); return last_status_; })) {
+            last_status_ = 1;
+            return;
+        }
+
         // If single stage and builtin that should run in parent
     if (cmds.size() == 1 && !cmds[0].argv.empty()) {
         const auto &argv = cmds[0].argv;
         if (argv[0] == "exit") exit(0);
+        // barrier marker for `teamshell -j`; run in order, lines are already done
+        if (argv[0] == "wait") { last_status_ = 0; return; }
+        // the builtins below run in this process: apply their redirections
+        // here for the duration of the call instead of forking
+        RedirectGuard redirect;
+        if (kParentBuiltins.count(argv[0]) && !redirect.apply(cmds[0])) {
+            last_status_ = 1;
+            return;
+        }
         if (argv[0] == "cd") {
             const char *path = nullptr;
             if (argv.size() >= 2) path = argv[1].c_str();
             else path = getenv("HOME");
             if (!path) path = "/";
-            if (chdir(path) != 0) perror("chdir");
+            last_status_ = 0;
+            if (chdir(path) != 0) { perror("chdir"); last_status_ = 1; }
+            return;
+        }
+        if (argv[0] == "set") {
+            last_status_ = set_builtin(argv);
             return;
         }
         if (argv[0] == "pwd") {
-            char buf[4096]; if (getcwd(buf, sizeof(buf))) puts(buf); else perror("getcwd");
+            char buf[4096]; last_status_ = 0;
+            if (getcwd(buf, sizeof(buf))) puts(buf); else { perror("getcwd"); last_status_ = 1; }
             return;
         }
         if (argv[0] == "ls") {
             // call C++ builtin ls
             extern int ls_builtin(const CommandLine &cl);
-            ls_builtin(cmds[0]);
+            last_status_ = ls_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "grep") {
             extern int grep_builtin(const CommandLine &cl);
-            grep_builtin(cmds[0]);
+            last_status_ = grep_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "cp") {
             extern int cp_builtin(const CommandLine &cl);
-            cp_builtin(cmds[0]);
+            last_status_ = cp_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "mv") {
             extern int mv_builtin(const CommandLine &cl);
-            mv_builtin(cmds[0]);
+            last_status_ = mv_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "rm") {
             extern int rm_builtin(const CommandLine &cl);
-            rm_builtin(cmds[0]);
+            last_status_ = rm_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "ln") {
             extern int ln_builtin(const CommandLine &cl);
-            ln_builtin(cmds[0]);
+            last_status_ = ln_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "mkdir") {
             extern int mkdir_builtin(const CommandLine &cl);
-            mkdir_builtin(cmds[0]);
+            last_status_ = mkdir_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "rmdir") {
             extern int rmdir_builtin(const CommandLine &cl);
-            rmdir_builtin(cmds[0]);
+            last_status_ = rmdir_builtin(cmds[0]);
             return;
         }
         if (argv[0] == "cat") {
             extern int cat_builtin(const CommandLine &cl);
-            cat_builtin(cmds[0]);
+            last_status_ = cat_builtin(cmds[0]);
             return;
         }
     }
@@ -185,14 +266,19 @@ void Shell::handleLine(const std::string &line) {
             } catch (...) {
                 // Ensure shell does not exit on unexpected exceptions; report via perror
                 perror("teamshell");
+                last_status_ = 1;
                 return;
             }
-            (void)rc; // return code is handled by command/builtin implementations
+            last_status_ = rc;
+        } else {
+            last_status_ = 2; // usage error reported by the factory
         }
     } catch (const std::exception &e) {
         fprintf(stderr, "teamshell: exception: %s\n", e.what());
+        last_status_ = 1;
     } catch (...) {
         // Last-resort: print errno-based message but do not exit shell
         perror("teamshell");
+        last_status_ = 1;
     }
 }
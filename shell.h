@@ -10,8 +10,11 @@ public:
     Shell();
     int runNonInteractive(std::istream &in);
     void handleLine(const std::string &line);
+    // exit status of the most recent handleLine (0 on success)
+    int lastStatus() const { return last_status_; }
 private:
     Parser parser_;
+    int last_status_ = 0;
 };
 
 #endif // TEAMSHELL_SHELL_H
@@ -0,0 +1,709 @@
+// sort.cpp - parallel external-memory sort builtin
+//
+// Input is read into a buffer bounded by the memory budget (-S/--memory).
+// Each full buffer is sorted with one thread per available CPU, then
+// written to an unlinked temp file as a sorted run. Runs are combined with
+// a k-way heap merge over large read buffers. Key extraction, numeric
+// comparison and the last-resort whole-line comparison follow GNU sort in
+// the C locale, so output is byte-identical to `LC_ALL=C sort`.
+#include "builtins.h"
+#include "text_io.h"
+#include "placement.h"
+#include "runtime_state.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t kDefaultMemory = 256 * 1024 * 1024;
+static const size_t kMinMemory = 16 * 1024;
+static const size_t kReadSize = 1024 * 1024;
+static const size_t kMaxMergeFanIn = 64;
+static const size_t kMinLinesPerThread = 16384;
+
+struct SortKey {
+    size_t sword = 0, schar = 0;        // start field/char, 0-based
+    size_t eword = SIZE_MAX, echar = 0; // end field/char; SIZE_MAX = end of line, echar 0 = end of field
+    bool skipsblanks = false, skipeblanks = false, numeric = false, reverse = false;
+    bool hasFlags() const { return skipsblanks || skipeblanks || numeric || reverse; }
+};
+
+struct SortOptions {
+    std::vector<SortKey> keys;
+    int tab = -1;                       // -1 = fields start at blank-to-nonblank transitions
+    bool unique = false, stable = false;
+    SortKey global;                     // -b/-n/-r given outside any key
+    size_t memory = kDefaultMemory;
+    unsigned threads = 0;
+    std::string tmpdir, output;
+};
+
+// text/len cover the line without its newline; kb/ke cache the first key
+struct Line {
+    const char *text;
+    size_t len;
+    const char *kb, *ke;
+};
+
+static inline bool is_blank(unsigned char c) { return c == ' ' || c == '\t'; }
+
+class LineCompare {
+public:
+    explicit LineCompare(const SortOptions &o) : o_(o) {}
+
+    void prepare(Line &l) const {
+        if (o_.keys.empty()) return;
+        const SortKey &k = o_.keys[0];
+        l.kb = begfield(l, k);
+        l.ke = k.eword == SIZE_MAX ? l.text + l.len : limfield(l, k);
+    }
+
+    int operator()(const Line &a, const Line &b) const {
+        if (!o_.keys.empty()) {
+            int diff = keycompare(a, b);
+            if (diff || o_.unique || o_.stable) return diff;
+        }
+        // last resort: compare whole lines bytewise
+        int diff = memcmp(a.text, b.text, std::min(a.len, b.len));
+        if (!diff) diff = (a.len > b.len) - (a.len < b.len);
+        return o_.global.reverse ? -diff : diff;
+    }
+
+    bool less(const Line &a, const Line &b) const { return (*this)(a, b) < 0; }
+
+private:
+    const char *begfield(const Line &l, const SortKey &k) const {
+        const char *ptr = l.text, *lim = l.text + l.len;
+        size_t sword = k.sword;
+        if (o_.tab >= 0) {
+            while (ptr < lim && sword--) {
+                while (ptr < lim && *ptr != (char)o_.tab) ++ptr;
+                if (ptr < lim) ++ptr;
+            }
+        } else {
+            while (ptr < lim && sword--) {
+                while (ptr < lim && is_blank(*ptr)) ++ptr;
+                while (ptr < lim && !is_blank(*ptr)) ++ptr;
+            }
+        }
+        if (k.skipsblanks) while (ptr < lim && is_blank(*ptr)) ++ptr;
+        return std::min<const char*>(lim, ptr + k.schar);
+    }
+
+    const char *limfield(const Line &l, const SortKey &k) const {
+        const char *ptr = l.text, *lim = l.text + l.len;
+        size_t eword = k.eword, echar = k.echar;
+        if (echar == 0) eword++; // take all of the end field
+        if (o_.tab >= 0) {
+            while (ptr < lim && eword--) {
+                while (ptr < lim && *ptr != (char)o_.tab) ++ptr;
+                if (ptr < lim && (eword || echar)) ++ptr;
+            }
+        } else {
+            while (ptr < lim && eword--) {
+                while (ptr < lim && is_blank(*ptr)) ++ptr;
+                while (ptr < lim && !is_blank(*ptr)) ++ptr;
+            }
+        }
+        if (echar != 0) {
+            if (k.skipeblanks) while (ptr < lim && is_blank(*ptr)) ++ptr;
+            ptr = std::min<const char*>(lim, ptr + echar);
+        }
+        return ptr;
+    }
+
+    int keycompare(const Line &a, const Line &b) const {
+        for (size_t i = 0; i < o_.keys.size(); ++i) {
+            const SortKey &k = o_.keys[i];
+            const char *ta, *la, *tb, *lb;
+            if (i == 0) { ta = a.kb; la = a.ke; tb = b.kb; lb = b.ke; }
+            else {
+                ta = begfield(a, k); la = k.eword == SIZE_MAX ? a.text + a.len : limfield(a, k);
+                tb = begfield(b, k); lb = k.eword == SIZE_MAX ? b.text + b.len : limfield(b, k);
+            }
+            size_t lena = la > ta ? la - ta : 0, lenb = lb > tb ? lb - tb : 0;
+            int diff;
+            if (k.numeric) diff = numcompare(ta, ta + lena, tb, tb + lenb);
+            else {
+                diff = memcmp(ta, tb, std::min(lena, lenb));
+                if (!diff) diff = (lena > lenb) - (lena < lenb);
+            }
+            if (diff) return k.reverse ? -diff : diff;
+        }
+        return 0;
+    }
+
+    // [blanks][-]digits[.digits]; anything else ends the number, no digits = 0
+    struct Number { bool neg; const char *ip; size_t il; const char *fp; size_t fl; };
+
+    static Number parse_number(const char *p, const char *e) {
+        Number n{false, p, 0, p, 0};
+        while (p < e && is_blank(*p)) ++p;
+        if (p < e && *p == '-') { n.neg = true; ++p; }
+        while (p < e && *p == '0') ++p;
+        n.ip = p;
+        while (p < e && isdigit((unsigned char)*p)) ++p;
+        n.il = p - n.ip;
+        if (p < e && *p == '.') {
+            n.fp = ++p;
+            while (p < e && isdigit((unsigned char)*p)) ++p;
+            n.fl = p - n.fp;
+            while (n.fl > 0 && n.fp[n.fl - 1] == '0') --n.fl;
+        }
+        if (n.il == 0 && n.fl == 0) n.neg = false; // -0 == 0
+        return n;
+    }
+
+    static int numcompare(const char *a, const char *ae, const char *b, const char *be) {
+        Number x = parse_number(a, ae), y = parse_number(b, be);
+        if (x.neg != y.neg) return x.neg ? -1 : 1;
+        int mag;
+        if (x.il != y.il) mag = x.il < y.il ? -1 : 1;
+        else if ((mag = memcmp(x.ip, y.ip, x.il)) == 0) {
+            mag = memcmp(x.fp, y.fp, std::min(x.fl, y.fl));
+            if (!mag) mag = (x.fl > y.fl) - (x.fl < y.fl);
+        }
+        return x.neg ? -mag : mag;
+    }
+
+    const SortOptions &o_;
+};
+
+// ---- option parsing ----------------------------------------------------
+
+static void sort_usage_error(const char *fmt, const std::string &arg) {
+    fprintf(stderr, "sort: ");
+    fprintf(stderr, fmt, arg.c_str());
+    fprintf(stderr, "\nTry 'sort --help' for more information.\n");
+}
+
+static bool parse_field_count(const char *&s, size_t &value, const char *what) {
+    if (!isdigit((unsigned char)*s)) {
+        fprintf(stderr, "sort: %s: invalid count at start of '%s'\n", what, s);
+        return false;
+    }
+    size_t v = 0;
+    while (isdigit((unsigned char)*s)) {
+        size_t d = *s++ - '0';
+        v = v > (SIZE_MAX - d) / 10 ? SIZE_MAX - 1 : v * 10 + d;
+    }
+    value = v;
+    return true;
+}
+
+static bool parse_key(const std::string &spec, SortKey &key) {
+    const char *s = spec.c_str();
+    if (!parse_field_count(s, key.sword, "invalid number at field start")) return false;
+    if (key.sword-- == 0) {
+        fprintf(stderr, "sort: field number is zero: invalid field specification '%s'\n", spec.c_str());
+        return false;
+    }
+    if (*s == '.') {
+        ++s;
+        if (!parse_field_count(s, key.schar, "invalid number after '.'")) return false;
+        if (key.schar-- == 0) {
+            fprintf(stderr, "sort: character offset is zero: invalid field specification '%s'\n", spec.c_str());
+            return false;
+        }
+    }
+    for (; *s && *s != ','; ++s) {
+        if (*s == 'b') key.skipsblanks = true;
+        else if (*s == 'n') key.numeric = true;
+        else if (*s == 'r') key.reverse = true;
+        else break;
+    }
+    if (*s == ',') {
+        ++s;
+        if (!parse_field_count(s, key.eword, "invalid number after ','")) return false;
+        if (key.eword-- == 0) {
+            fprintf(stderr, "sort: field number is zero: invalid field specification '%s'\n", spec.c_str());
+            return false;
+        }
+        if (*s == '.') {
+            ++s;
+            if (!parse_field_count(s, key.echar, "invalid number after '.'")) return false;
+        }
+        for (; *s; ++s) {
+            if (*s == 'b') key.skipeblanks = true;
+            else if (*s == 'n') key.numeric = true;
+            else if (*s == 'r') key.reverse = true;
+            else break;
+        }
+    }
+    if (*s) {
+        fprintf(stderr, "sort: stray character in field spec: invalid field specification '%s'\n", spec.c_str());
+        return false;
+    }
+    return true;
+}
+
+// SIZE[bKMGT%]; a bare number means KiB as in GNU sort
+static bool parse_memory(const std::string &arg, size_t &out) {
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long v = strtoull(arg.c_str(), &end, 10);
+    if (arg.empty() || !isdigit((unsigned char)arg[0]) || errno) {
+        fprintf(stderr, "sort: invalid -S argument '%s'\n", arg.c_str());
+        return false;
+    }
+    unsigned long long mult = 1024;
+    if (*end) {
+        switch (end[1] ? 0 : *end) {
+        case 'b': mult = 1; break;
+        case 'k': case 'K': mult = 1ULL << 10; break;
+        case 'M': mult = 1ULL << 20; break;
+        case 'G': mult = 1ULL << 30; break;
+        case 'T': mult = 1ULL << 40; break;
+        case '%': {
+            long pages = sysconf(_SC_PHYS_PAGES), psize = sysconf(_SC_PAGESIZE);
+            out = (size_t)((double)pages * psize * v / 100);
+            return true;
+        }
+        default:
+            fprintf(stderr, "sort: invalid suffix in -S argument '%s'\n", arg.c_str());
+            return false;
+        }
+    }
+    out = v > SIZE_MAX / mult ? SIZE_MAX : v * mult;
+    return true;
+}
+
+// returns -1 on success, otherwise the exit status
+static int parse_sort_args(const CommandLine &cl, SortOptions &o, std::vector<std::string> &files) {
+    const auto &argv = cl.argv;
+    auto need = [&](size_t &i, const std::string &a, size_t k, std::string &val, char opt) -> bool {
+        if (k + 1 < a.size()) { val = a.substr(k + 1); return true; }
+        if (i + 1 >= argv.size()) {
+            sort_usage_error("option requires an argument -- '%s'", std::string(1, opt));
+            return false;
+        }
+        val = argv[++i];
+        return true;
+    };
+    auto apply = [&](char opt, const std::string &val) -> bool {
+        switch (opt) {
+        case 'k': {
+            SortKey key;
+            if (!parse_key(val, key)) return false;
+            o.keys.push_back(key);
+            return true;
+        }
+        case 't':
+            if (val.empty()) { fprintf(stderr, "sort: empty tab\n"); return false; }
+            if (val == "\\0") { o.tab = 0; return true; }
+            if (val.size() > 1) { fprintf(stderr, "sort: multi-character tab '%s'\n", val.c_str()); return false; }
+            if (o.tab >= 0 && o.tab != (unsigned char)val[0]) { fprintf(stderr, "sort: incompatible tabs\n"); return false; }
+            o.tab = (unsigned char)val[0];
+            return true;
+        case 'S': return parse_memory(val, o.memory);
+        case 'T': o.tmpdir = val; return true;
+        case 'o': o.output = val; return true;
+        case 'P': {
+            char *end;
+            long n = strtol(val.c_str(), &end, 10);
+            if (val.empty() || *end || n <= 0) { fprintf(stderr, "sort: invalid number of threads '%s'\n", val.c_str()); return false; }
+            o.threads = (unsigned)n;
+            return true;
+        }
+        }
+        return false;
+    };
+    struct LongOpt { const char *name; char opt; bool has_arg; };
+    static const LongOpt longs[] = {
+        {"numeric-sort", 'n', false}, {"reverse", 'r', false}, {"unique", 'u', false},
+        {"stable", 's', false}, {"ignore-leading-blanks", 'b', false}, {"key", 'k', true},
+        {"field-separator", 't', true}, {"output", 'o', true}, {"buffer-size", 'S', true},
+        {"memory", 'S', true}, {"temporary-directory", 'T', true}, {"parallel", 'P', true},
+    };
+    bool opts_done = false;
+    for (size_t i = 1; i < argv.size(); ++i) {
+        const std::string &a = argv[i];
+        if (opts_done || a == "-" || a.size() < 2 || a[0] != '-') { files.push_back(a); continue; }
+        if (a == "--") { opts_done = true; continue; }
+        if (a.compare(0, 2, "--") == 0) {
+            std::string name = a.substr(2), val;
+            size_t eq = name.find('=');
+            bool has_val = eq != std::string::npos;
+            if (has_val) { val = name.substr(eq + 1); name.resize(eq); }
+            const LongOpt *lo = nullptr;
+            for (const auto &l : longs) if (name == l.name) { lo = &l; break; }
+            if (!lo) { sort_usage_error("unrecognized option '%s'", a); return 2; }
+            if (lo->has_arg && !has_val) {
+                if (i + 1 >= argv.size()) { sort_usage_error("option '%s' requires an argument", "--" + name); return 2; }
+                val = argv[++i];
+            }
+            if (lo->has_arg) { if (!apply(lo->opt, val)) return 2; continue; }
+            switch (lo->opt) {
+            case 'n': o.global.numeric = true; break;
+            case 'r': o.global.reverse = true; break;
+            case 'u': o.unique = true; break;
+            case 's': o.stable = true; break;
+            case 'b': o.global.skipsblanks = o.global.skipeblanks = true; break;
+            }
+            continue;
+        }
+        for (size_t k = 1; k < a.size(); ++k) {
+            char c = a[k];
+            if (c == 'n') o.global.numeric = true;
+            else if (c == 'r') o.global.reverse = true;
+            else if (c == 'u') o.unique = true;
+            else if (c == 's') o.stable = true;
+            else if (c == 'b') o.global.skipsblanks = o.global.skipeblanks = true;
+            else if (c == 'k' || c == 't' || c == 'S' || c == 'T' || c == 'o') {
+                std::string val;
+                if (!need(i, a, k, val, c) || !apply(c, val)) return 2;
+                break;
+            } else {
+                sort_usage_error("invalid option -- '%s'", std::string(1, c));
+                return 2;
+            }
+        }
+    }
+    // keys without their own ordering flags inherit the global ones
+    for (auto &k : o.keys) {
+        if (!k.hasFlags()) {
+            k.skipsblanks = o.global.skipsblanks;
+            k.skipeblanks = o.global.skipeblanks;
+            k.numeric = o.global.numeric;
+            k.reverse = o.global.reverse;
+        }
+    }
+    if (o.keys.empty() && o.global.hasFlags()) o.keys.push_back(o.global);
+    if (files.empty()) files.push_back("-");
+    if (o.threads == 0) o.threads = allowed_cpu_count();
+    o.memory = std::max(o.memory, kMinMemory);
+    if (o.tmpdir.empty()) {
+        const char *t = getenv("TMPDIR");
+        o.tmpdir = (t && *t) ? t : "/tmp";
+    }
+    return -1;
+}
+
+// ---- sorting -----------------------------------------------------------
+
+// sort v with up to `threads` workers: slices are sorted concurrently, then
+// merged pairwise. Stable whenever ties can be observed (-u, -s).
+static void parallel_sort(std::vector<Line> &v, const LineCompare &cmp, unsigned threads, bool stable) {
+    auto less = [&](const Line &a, const Line &b) { return cmp.less(a, b); };
+    unsigned parts = std::min<size_t>(threads, std::max<size_t>(1, v.size() / kMinLinesPerThread));
+    if (parts <= 1) {
+        if (stable) std::stable_sort(v.begin(), v.end(), less);
+        else std::sort(v.begin(), v.end(), less);
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (unsigned i = 0; i <= parts; ++i) bounds.push_back(v.size() * i / parts);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < parts; ++i) {
+        workers.emplace_back([&, i] {
+            if (stable) std::stable_sort(v.begin() + bounds[i], v.begin() + bounds[i + 1], less);
+            else std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1], less);
+        });
+    }
+    for (auto &t : workers) t.join();
+    while (bounds.size() > 2) {
+        std::vector<size_t> next;
+        workers.clear();
+        for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+            size_t lo = bounds[i], mid = bounds[i + 1], hi = bounds[i + 2];
+            workers.emplace_back([&, lo, mid, hi] {
+                std::inplace_merge(v.begin() + lo, v.begin() + mid, v.begin() + hi, less);
+            });
+            next.push_back(lo);
+        }
+        if (bounds.size() % 2 == 0) next.push_back(bounds[bounds.size() - 2]);
+        next.push_back(bounds.back());
+        for (auto &t : workers) t.join();
+        bounds.swap(next);
+    }
+}
+
+// sequential reader over one sorted run
+class RunReader {
+public:
+    RunReader(int fd, size_t bufsize, const LineCompare &cmp) : fd_(fd), buf_(bufsize), cmp_(cmp) {}
+    ~RunReader() { close(fd_); }
+    const Line &current() const { return cur_; }
+    // advance to the next line; false at end of run or on read error
+    bool next() {
+        beg_ = pos_;
+        while (true) {
+            const void *nl = memchr(buf_.data() + pos_, '\n', end_ - pos_);
+            if (nl) {
+                size_t at = static_cast<const char*>(nl) - buf_.data();
+                cur_.text = buf_.data() + beg_;
+                cur_.len = at - beg_;
+                cmp_.prepare(cur_);
+                pos_ = at + 1;
+                return true;
+            }
+            // shift the partial line down and refill
+            if (beg_ > 0) {
+                memmove(buf_.data(), buf_.data() + beg_, end_ - beg_);
+                end_ -= beg_;
+                beg_ = 0;
+            }
+            if (end_ == buf_.size()) buf_.resize(buf_.size() * 2);
+            pos_ = end_;
+            ssize_t r;
+            do { r = read(fd_, buf_.data() + end_, buf_.size() - end_); } while (r < 0 && errno == EINTR);
+            if (r <= 0) { error_ = r < 0; return false; }
+            end_ += r;
+        }
+    }
+    bool error() const { return error_; }
+private:
+    int fd_;
+    std::vector<char> buf_;
+    size_t beg_ = 0, pos_ = 0, end_ = 0;
+    Line cur_{};
+    bool error_ = false;
+    const LineCompare &cmp_;
+};
+
+class ExternalSorter {
+public:
+    // the buffer reserves the whole budget up front; pages are only
+    // committed as input arrives, so small inputs stay cheap
+    ExternalSorter(const SortOptions &o) : o_(o), cmp_(o) {
+        void *m = mmap(nullptr, o.memory, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (m != MAP_FAILED) { buf_ = static_cast<char*>(m); cap_ = o.memory; }
+    }
+    ~ExternalSorter() {
+        if (buf_) munmap(buf_, cap_);
+        for (int fd : runs_) close(fd);
+    }
+
+    // read one input to EOF; returns false (after reporting) on error
+    bool consume(int fd, const std::string &name) {
+        while (true) {
+            if (!buf_) { fprintf(stderr, "sort: memory exhausted\n"); return false; }
+            if (interrupted) return false;
+            if (used_ == cap_ && !makeRoom()) return false;
+            ssize_t r;
+            do { r = read(fd, buf_ + used_, std::min(cap_ - used_, kReadSize)); } while (r < 0 && errno == EINTR && !interrupted);
+            if (r < 0) {
+                if (interrupted) return false; // Ctrl-C while blocked on a terminal or pipe
+                fprintf(stderr, "sort: read failed: %s: %s\n", name == "-" ? "-" : name.c_str(), strerror(errno));
+                return false;
+            }
+            if (r == 0) break;
+            used_ += r;
+            scanLines();
+            if (used_ + lines_.size() * sizeof(Line) >= o_.memory && !spill()) return false;
+        }
+        // a last line without a newline still counts as a line
+        if (line_start_ < used_) {
+            addLine(line_start_, used_ - line_start_);
+            line_start_ = scan_ = used_;
+        }
+        return true;
+    }
+
+    bool finish(int out_fd) {
+        if (runs_.empty()) {
+            parallel_sort(lines_, cmp_, o_.threads, o_.unique || o_.stable);
+            OutBuf out(out_fd);
+            writeLines(lines_, out);
+            out.flush();
+            return !out.failed() && !interrupted;
+        }
+        if (!lines_.empty() && !spill()) return false;
+        // merge in passes of at most kMaxMergeFanIn runs, keeping run order
+        while (runs_.size() > kMaxMergeFanIn) {
+            int fd = makeTemp();
+            if (fd < 0) return false;
+            std::vector<int> group(runs_.begin(), runs_.begin() + kMaxMergeFanIn);
+            OutBuf out(fd);
+            if (!merge(group, out)) {
+                // the readers closed the group's fds
+                runs_.erase(runs_.begin(), runs_.begin() + kMaxMergeFanIn);
+                close(fd);
+                return false;
+            }
+            out.flush();
+            if (out.failed() || lseek(fd, 0, SEEK_SET) != 0) { tempWriteError(); close(fd); return false; }
+            runs_.erase(runs_.begin(), runs_.begin() + kMaxMergeFanIn);
+            runs_.insert(runs_.begin(), fd);
+        }
+        std::vector<int> group;
+        group.swap(runs_);
+        OutBuf out(out_fd);
+        if (!merge(group, out)) return false;
+        out.flush();
+        return !out.failed();
+    }
+
+private:
+    void addLine(size_t off, size_t len) {
+        Line l{buf_ + off, len, nullptr, nullptr};
+        cmp_.prepare(l);
+        lines_.push_back(l);
+    }
+
+    void scanLines() {
+        while (scan_ < used_) {
+            const void *nl = memchr(buf_ + scan_, '\n', used_ - scan_);
+            if (!nl) { scan_ = used_; break; }
+            size_t at = static_cast<const char*>(nl) - buf_;
+            addLine(line_start_, at - line_start_);
+            line_start_ = scan_ = at + 1;
+        }
+    }
+
+    // free buffer space by spilling complete lines; a single line longer
+    // than the budget grows the buffer past it
+    bool makeRoom() {
+        if (!lines_.empty()) return spill();
+        if (line_start_ > 0) { compact(); return true; }
+        void *m = mremap(buf_, cap_, cap_ * 2, MREMAP_MAYMOVE);
+        if (m == MAP_FAILED) { fprintf(stderr, "sort: memory exhausted\n"); return false; }
+        buf_ = static_cast<char*>(m);
+        cap_ *= 2;
+        return true;
+    }
+
+    void compact() {
+        memmove(buf_, buf_ + line_start_, used_ - line_start_);
+        used_ -= line_start_;
+        scan_ -= line_start_;
+        line_start_ = 0;
+    }
+
+    int makeTemp() {
+        std::string path = o_.tmpdir + "/teamshell-sortXXXXXX";
+        std::vector<char> tmpl(path.begin(), path.end());
+        tmpl.push_back('\0');
+        int fd = mkostemp(tmpl.data(), O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "sort: cannot create temporary file in '%s': %s\n", o_.tmpdir.c_str(), strerror(errno));
+            return -1;
+        }
+        unlink(tmpl.data()); // the run lives only as long as its fd
+        return fd;
+    }
+
+    void tempWriteError() {
+        fprintf(stderr, "sort: write failed: %s: %s\n", o_.tmpdir.c_str(), strerror(errno ? errno : EIO));
+    }
+
+    // sort the complete lines in the buffer and write them out as a run
+    bool spill() {
+        parallel_sort(lines_, cmp_, o_.threads, o_.unique || o_.stable);
+        if (interrupted) return false;
+        int fd = makeTemp();
+        if (fd < 0) return false;
+        OutBuf out(fd);
+        writeLines(lines_, out);
+        out.flush();
+        if (out.failed() || lseek(fd, 0, SEEK_SET) != 0) { tempWriteError(); close(fd); return false; }
+        runs_.push_back(fd);
+        lines_.clear();
+        compact();
+        return true;
+    }
+
+    void writeLines(const std::vector<Line> &lines, OutBuf &out) const {
+        const Line *prev = nullptr;
+        for (const auto &l : lines) {
+            if (interrupted) return;
+            if (o_.unique && prev && cmp_(*prev, l) == 0) continue;
+            out.put(l.text, l.len);
+            out.put('\n');
+            prev = &l;
+        }
+    }
+
+    // k-way merge; ties go to the earlier run so -u keeps the first input line
+    bool merge(const std::vector<int> &fds, OutBuf &out) {
+        size_t bufsize = std::max<size_t>(64 * 1024, std::min<size_t>(o_.memory / (fds.size() + 1), 8 * kReadSize));
+        std::vector<std::unique_ptr<RunReader>> readers;
+        std::vector<size_t> heap;
+        auto after = [&](size_t a, size_t b) {
+            int d = cmp_(readers[a]->current(), readers[b]->current());
+            return d > 0 || (d == 0 && a > b);
+        };
+        for (size_t i = 0; i < fds.size(); ++i) {
+            readers.emplace_back(new RunReader(fds[i], bufsize, cmp_));
+            if (readers[i]->next()) heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), after);
+        std::string last;
+        bool have_last = false;
+        while (!heap.empty()) {
+            if (interrupted) return false;
+            std::pop_heap(heap.begin(), heap.end(), after);
+            size_t r = heap.back();
+            const Line &l = readers[r]->current();
+            bool dup = false;
+            if (o_.unique) {
+                if (have_last) {
+                    Line prev{last.data(), last.size(), nullptr, nullptr};
+                    cmp_.prepare(prev);
+                    dup = cmp_(prev, l) == 0;
+                }
+                if (!dup) { last.assign(l.text, l.len); have_last = true; }
+            }
+            if (!dup) { out.put(l.text, l.len); out.put('\n'); }
+            if (readers[r]->next()) std::push_heap(heap.begin(), heap.end(), after);
+            else {
+                heap.pop_back();
+                if (readers[r]->error()) { fprintf(stderr, "sort: read failed: %s: %s\n", o_.tmpdir.c_str(), strerror(errno)); return false; }
+            }
+        }
+        return true;
+    }
+
+    const SortOptions &o_;
+    LineCompare cmp_;
+    char *buf_ = nullptr;
+    size_t cap_ = 0, used_ = 0;
+    size_t line_start_ = 0, scan_ = 0;  // start of the incomplete line / scan position
+    std::vector<Line> lines_;
+    std::vector<int> runs_;
+};
+
+int sort_builtin(const CommandLine &cl) {
+    SortOptions o;
+    std::vector<std::string> files;
+    int rc = parse_sort_args(cl, o, files);
+    if (rc >= 0) return rc;
+
+    interrupted = 0;
+    ExternalSorter sorter(o);
+    for (const auto &name : files) {
+        int fd = name == "-" ? STDIN_FILENO : open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "sort: cannot read: %s: %s\n", name.c_str(), strerror(errno));
+            return 2;
+        }
+        bool ok = sorter.consume(fd, name);
+        if (fd != STDIN_FILENO) close(fd);
+        if (!ok) return interrupted ? 130 : 2;
+    }
+    // the output file is opened only after all input is read, so -o may name an input
+    int out_fd = STDOUT_FILENO;
+    if (!o.output.empty()) {
+        out_fd = open(o.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0) {
+            fprintf(stderr, "sort: open failed: %s: %s\n", o.output.c_str(), strerror(errno));
+            return 2;
+        }
+    }
+    bool ok = sorter.finish(out_fd);
+    if (out_fd != STDOUT_FILENO) close(out_fd);
+    if (interrupted) return 130;
+    return ok ? 0 : 2;
+}
@@ -1,9 +1,60 @@
 // teamshell.cpp - entrypoint that uses Shell class implemented in shell.*
 #include "shell.h"
+#include "batch.h"
+#include "placement.h"
+#include "server.h"
+#include "zygote.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+
+static int usage() {
+    fprintf(stderr, "usage: teamshell [--server SOCKET | --client SOCKET (-c COMMAND | SCRIPT) | -j JOBS [SCRIPT]]\n");
+    return 2;
+}
 
 int main(int argc, char **argv) {
-    (void)argc; (void)argv;
+    if (argc >= 2 && strcmp(argv[1], "--server") == 0) {
+        if (argc != 3) return usage();
+        ShellServer server(argv[2]);
+        return server.run();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--client") == 0) {
+        if (argc == 5 && strcmp(argv[3], "-c") == 0)
+            return run_server_client(argv[2], std::string(argv[4]) + "\n");
+        if (argc != 4) return usage();
+        std::ifstream f(argv[3]);
+        if (!f) { perror(argv[3]); return 127; }
+        std::stringstream ss;
+        ss << f.rdbuf();
+        return run_server_client(argv[2], ss.str());
+    }
+    int jobs = 0;
+    const char *script = nullptr;
+    if (argc >= 2 && strcmp(argv[1], "-j") == 0) {
+        if (argc < 3 || argc > 4) return usage();
+        char *end = nullptr;
+        long n = strtol(argv[2], &end, 10);
+        if (*argv[2] == '\0' || *end != '\0' || n < 0) return usage();
+        // -j 0: one job per usable CPU
+        jobs = n > 0 ? (int)n : allowed_cpu_count();
+        if (argc == 4) script = argv[3];
+    } else if (argc > 1) {
+        return usage();
+    }
+    // start the launch helper while this process is still small
+    const char *zygote = getenv("TEAMSHELL_ZYGOTE");
+    if (zygote && strcmp(zygote, "0") != 0) Zygote::start();
     Shell shell;
+    if (jobs > 0) {
+        BatchRunner runner(shell, jobs);
+        if (!script) return runner.run(std::cin);
+        std::ifstream f(script);
+        if (!f) { perror(script); return 127; }
+        return runner.run(f);
+    }
     return shell.runNonInteractive(std::cin);
 }
@@ -0,0 +1,640 @@
+// text_builtins.cpp - streaming text builtins: wc, head, tail, uniq
+//
+// Inputs are mmap'd when they are regular files and read in large chunks
+// otherwise. Newline and word counting scan 16 bytes per step with SSE2.
+// Output and error messages follow GNU coreutils for the supported flags.
+// The builtins run inside the shell, so input stops at Ctrl-C (the shell
+// sets `interrupted`) and they return 130 like a killed command.
+#include "builtins.h"
+#include "text_io.h"
+#include "follow.h"
+#include "runtime_state.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// mapped files are handed out in slices so Ctrl-C is noticed between them
+static const size_t kMapSlice = 4 * 1024 * 1024;
+
+// ---- shared helpers ----------------------------------------------------
+
+// one input file: whole-file mmap for regular files, chunked reads otherwise
+class Input {
+public:
+    ~Input() {
+        if (map_) munmap(map_, map_len_);
+        if (fd_ > STDERR_FILENO) close(fd_);
+    }
+    // "-" means stdin; on failure returns false with errno set
+    bool open(const std::string &path) {
+        fd_ = (path == "-") ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (fstat(fd_, &st) != 0) return false;
+        regular_ = S_ISREG(st.st_mode);
+        if (regular_) {
+            off_t cur = lseek(fd_, 0, SEEK_CUR);
+            offset_ = cur > 0 ? cur : 0;
+            size_ = st.st_size > offset_ ? st.st_size - offset_ : 0;
+        }
+        return true;
+    }
+    int fd() const { return fd_; }
+    bool regular() const { return regular_; }
+    off_t size() const { return size_; }   // bytes left, regular files only
+    off_t offset() const { return offset_; }
+    // map the remaining file (regular files only); nullptr if empty or unmappable
+    const char *map() {
+        if (!regular_ || size_ == 0) return nullptr;
+        if (!map_) {
+            void *m = mmap(nullptr, size_ + offset_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (m == MAP_FAILED) return nullptr;
+            map_ = m; map_len_ = size_ + offset_;
+            madvise(map_, map_len_, MADV_SEQUENTIAL);
+        }
+        return static_cast<const char*>(map_) + offset_;
+    }
+    // next chunk of input; false at EOF, on error (see error()) or once
+    // `interrupted` is set
+    bool next(const char *&p, size_t &n) {
+        if (interrupted) return false;
+        if (regular_ && !done_) {
+            done_ = true;
+            if (map() == nullptr && size_ == 0) return readChunk(p, n); // e.g. /proc files report 0
+        }
+        if (map_) {
+            if (consumed_ >= size_) return false;
+            p = static_cast<const char*>(map_) + offset_ + consumed_;
+            n = std::min<off_t>(kMapSlice, size_ - consumed_);
+            consumed_ += n;
+            return true;
+        }
+        return readChunk(p, n);
+    }
+    int error() const { return err_; }
+    // leave the file offset after what was consumed, as coreutils does for stdin
+    void settle() { if (map_ && fd_ == STDIN_FILENO) lseek(fd_, offset_ + consumed_, SEEK_SET); }
+    void consumed(size_t n) { consumed_ = n; }
+private:
+    bool readChunk(const char *&p, size_t &n) {
+        if (buf_.empty()) buf_.resize(kChunkSize);
+        ssize_t r;
+        do { r = read(fd_, buf_.data(), buf_.size()); } while (r < 0 && errno == EINTR && !interrupted);
+        if (r < 0) { if (!interrupted) err_ = errno; return false; }
+        if (r == 0) return false;
+        p = buf_.data(); n = r;
+        return true;
+    }
+    int fd_ = -1;
+    bool regular_ = false;
+    bool done_ = false;
+    off_t size_ = 0, offset_ = 0, consumed_ = 0;
+    void *map_ = nullptr;
+    size_t map_len_ = 0;
+    std::vector<char> buf_;
+    int err_ = 0;
+};
+
+static size_t count_newlines(const char *p, size_t n) {
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 64 <= n; i += 64) {
+        uint64_t m0 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), nl));
+        uint64_t m1 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + 16)), nl));
+        uint64_t m2 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + 32)), nl));
+        uint64_t m3 = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + 48)), nl));
+        count += __builtin_popcountll(m0 | (m1 << 16) | (m2 << 32) | (m3 << 48));
+    }
+    for (; i + 16 <= n; i += 16)
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), nl)));
+#endif
+    for (; i < n; ++i) count += (p[i] == '\n');
+    return count;
+}
+
+static inline bool is_space(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+static inline bool is_graph(unsigned char c) { return c > ' ' && c < 0x7f; }
+
+// count words as coreutils wc does in the C locale: a printable byte starts
+// a word unless one is already open, whitespace closes it, and any other
+// byte leaves the state alone. *in_word carries the state across chunks.
+static size_t count_words(const char *p, size_t n, bool *in_word) {
+    size_t words = 0, i = 0;
+    bool state = *in_word;
+#ifdef __SSE2__
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const __m128i bang = _mm_set1_epi8('!');
+    const __m128i graph_span = _mm_set1_epi8(0x7e - '!');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i d = _mm_sub_epi8(v, tab);  // '\t'..'\r' map to 0..4
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(d, four), d);
+        unsigned sp_mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, sp), ctl));
+        __m128i g = _mm_sub_epi8(v, bang);  // '!'..'~' map to 0..0x5d
+        unsigned graph = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(g, graph_span), g));
+        if ((sp_mask | graph) != 0xFFFFu) {
+            // control or high bytes present: walk this block byte by byte
+            for (size_t k = i; k < i + 16; ++k) {
+                unsigned char c = p[k];
+                if (is_space(c)) state = false;
+                else if (is_graph(c) && !state) { state = true; ++words; }
+            }
+            continue;
+        }
+        unsigned starts = graph & ~((graph << 1) | (state ? 1u : 0u)) & 0xFFFFu;
+        words += __builtin_popcount(starts);
+        state = (graph >> 15) & 1;
+    }
+#endif
+    for (; i < n; ++i) {
+        unsigned char c = p[i];
+        if (is_space(c)) state = false;
+        else if (is_graph(c) && !state) { state = true; ++words; }
+    }
+    *in_word = state;
+    return words;
+}
+
+static void input_error(const char *prog, const std::string &name, int err) {
+    fprintf(stderr, "%s: %s: %s\n", prog, name == "-" ? "standard input" : name.c_str(), strerror(err));
+}
+
+static void open_error(const char *prog, const std::string &name, int err) {
+    fprintf(stderr, "%s: cannot open '%s' for reading: %s\n", prog, name.c_str(), strerror(err));
+}
+
+// parse a non-negative count, optionally signed; returns false on junk
+static bool parse_count(const std::string &s, long long &value, char *sign) {
+    size_t i = 0;
+    *sign = 0;
+    if (i < s.size() && (s[i] == '+' || s[i] == '-')) *sign = s[i++];
+    if (i == s.size()) return false;
+    long long v = 0;
+    for (; i < s.size(); ++i) {
+        if (!isdigit((unsigned char)s[i])) return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    value = v;
+    return true;
+}
+
+static void print_header(OutBuf &out, const std::string &name, bool first) {
+    if (!first) out.put('\n');
+    out.put("==> ");
+    out.put(name == "-" ? std::string_view("standard input") : std::string_view(name));
+    out.put(" <==\n");
+}
+
+// ---- wc ----------------------------------------------------------------
+
+struct WcCounts { uint64_t lines = 0, words = 0, bytes = 0; };
+
+int wc_builtin(const CommandLine &cl) {
+    bool lines = false, words = false, chars = false, bytes = false;
+    std::vector<std::string> files;
+    bool opts_done = false;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (opts_done || a == "-" || a.size() < 2 || a[0] != '-') { files.push_back(a); continue; }
+        if (a == "--") { opts_done = true; continue; }
+        if (a == "--lines") { lines = true; continue; }
+        if (a == "--words") { words = true; continue; }
+        if (a == "--chars") { chars = true; continue; }
+        if (a == "--bytes") { bytes = true; continue; }
+        for (size_t k = 1; k < a.size(); ++k) {
+            switch (a[k]) {
+            case 'l': lines = true; break;
+            case 'w': words = true; break;
+            case 'm': chars = true; break;
+            case 'c': bytes = true; break;
+            default:
+                fprintf(stderr, "wc: invalid option -- '%c'\nTry 'wc --help' for more information.\n", a[k]);
+                return 1;
+            }
+        }
+    }
+    if (!lines && !words && !chars && !bytes) lines = words = bytes = true;
+    interrupted = 0;
+    bool named = !files.empty();
+    if (!named) files.push_back("-");
+
+    // field width as in coreutils: digits of the total regular-file size,
+    // at least 7 if any input is not a regular file; 1 for a lone count.
+    // Sizes come from stat so each line can be printed as soon as it is counted.
+    int width = 1;
+    if ((int)lines + (int)words + (int)chars + (int)bytes > 1 || files.size() > 1) {
+        uint64_t regular_total = 0;
+        bool has_nonregular = false;
+        for (size_t f = 0; f < files.size(); ++f) {
+            struct stat st;
+            int r = files[f] == "-" ? fstat(STDIN_FILENO, &st) : stat(files[f].c_str(), &st);
+            if (r != 0) continue;
+            if (S_ISREG(st.st_mode)) regular_total += st.st_size; else has_nonregular = true;
+        }
+        for (uint64_t t = regular_total; t >= 10; t /= 10) width++;
+        if (has_nonregular && width < 7) width = 7;
+    }
+
+    int ret = 0;
+    OutBuf out;
+    auto print = [&](const WcCounts &c, const char *name) {
+        char buf[128];
+        int len = 0;
+        const char *sep = "";
+        if (lines) { len += snprintf(buf + len, sizeof(buf) - len, "%s%*llu", sep, width, (unsigned long long)c.lines); sep = " "; }
+        if (words) { len += snprintf(buf + len, sizeof(buf) - len, "%s%*llu", sep, width, (unsigned long long)c.words); sep = " "; }
+        // C locale: characters are bytes
+        if (chars) { len += snprintf(buf + len, sizeof(buf) - len, "%s%*llu", sep, width, (unsigned long long)c.bytes); sep = " "; }
+        if (bytes) { len += snprintf(buf + len, sizeof(buf) - len, "%s%*llu", sep, width, (unsigned long long)c.bytes); }
+        out.put(buf, len);
+        if (name) { out.put(' '); out.put(name); }
+        out.put('\n');
+    };
+    WcCounts total;
+    for (const auto &name : files) {
+        Input in;
+        if (!in.open(name)) { out.flush(); input_error("wc", name, errno); ret = 1; continue; }
+        WcCounts c;
+        if (!lines && !words && in.regular() && in.size() > 0) {
+            c.bytes = in.size(); // byte count only: no need to read
+            if (in.fd() == STDIN_FILENO) lseek(in.fd(), 0, SEEK_END);
+        } else {
+            bool in_word = false;
+            const char *p; size_t n;
+            while (in.next(p, n)) {
+                c.bytes += n;
+                if (lines) c.lines += count_newlines(p, n);
+                if (words) c.words += count_words(p, n, &in_word);
+            }
+            in.settle();
+            if (in.error()) { out.flush(); input_error("wc", name, in.error()); ret = 1; }
+        }
+        if (interrupted) return 130;
+        print(c, named ? name.c_str() : nullptr);
+        total.lines += c.lines;
+        total.words += c.words;
+        total.bytes += c.bytes;
+    }
+    if (files.size() > 1) print(total, "total");
+    return ret;
+}
+
+// ---- head --------------------------------------------------------------
+
+// start offset of the line that ends at pos (exclusive) within data
+static size_t line_start_before(const char *data, size_t pos) {
+    if (pos <= 1) return 0;
+    const void *q = memrchr(data, '\n', pos - 1);
+    return q ? (static_cast<const char*>(q) - data) + 1 : 0;
+}
+
+static void read_all(Input &in, std::string &all) {
+    const char *p; size_t n;
+    while (in.next(p, n)) all.append(p, n);
+}
+
+int head_builtin(const CommandLine &cl) {
+    long long count = 10;
+    bool by_bytes = false, elide = false;
+    int headers = 0; // 0 = auto, 1 = always (-v), -1 = never (-q)
+    std::vector<std::string> files;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (a == "-" || a.size() < 2 || a[0] != '-') { files.push_back(a); continue; }
+        if (a == "--") { files.insert(files.end(), cl.argv.begin() + i + 1, cl.argv.end()); break; }
+        std::string val;
+        bool need_val = false;
+        if (a == "-q" || a == "--quiet" || a == "--silent") { headers = -1; continue; }
+        if (a == "-v" || a == "--verbose") { headers = 1; continue; }
+        if (isdigit((unsigned char)a[1])) { val = a.substr(1); by_bytes = false; }
+        else if (a[1] == 'n' || a[1] == 'c') {
+            by_bytes = (a[1] == 'c');
+            if (a.size() > 2) val = a.substr(2); else need_val = true;
+        } else if (a.compare(0, 8, "--lines=") == 0) { by_bytes = false; val = a.substr(8); }
+        else if (a.compare(0, 8, "--bytes=") == 0) { by_bytes = true; val = a.substr(8); }
+        else { fprintf(stderr, "head: invalid option -- '%c'\nTry 'head --help' for more information.\n", a[1]); return 1; }
+        if (need_val) {
+            if (i + 1 >= cl.argv.size()) { fprintf(stderr, "head: option requires an argument -- '%c'\n", a[1]); return 1; }
+            val = cl.argv[++i];
+        }
+        char sign;
+        // GNU head reads +N as N
+        if (!parse_count(val, count, &sign)) {
+            fprintf(stderr, "head: invalid number of %s: '%s'\n", by_bytes ? "bytes" : "lines", val.c_str());
+            return 1;
+        }
+        elide = (sign == '-');
+    }
+    if (files.empty()) files.push_back("-");
+    bool show_headers = headers == 1 || (headers == 0 && files.size() > 1);
+    interrupted = 0;
+
+    int ret = 0;
+    OutBuf out;
+    bool first = true;
+    for (const auto &name : files) {
+        if (interrupted) break;
+        Input in;
+        if (!in.open(name)) { out.flush(); open_error("head", name, errno); ret = 1; continue; }
+        if (show_headers) { print_header(out, name, first); }
+        first = false;
+        if (!elide) {
+            // stream until count lines/bytes have been copied
+            unsigned long long left = count;
+            const char *p; size_t n;
+            size_t used = 0;
+            while (left > 0 && in.next(p, n)) {
+                size_t take = n;
+                if (by_bytes) {
+                    take = std::min<unsigned long long>(n, left);
+                    left -= take;
+                } else {
+                    const char *cur = p, *end = p + n;
+                    while (left > 0 && cur < end) {
+                        const char *nl = static_cast<const char*>(memchr(cur, '\n', end - cur));
+                        if (!nl) { cur = end; break; }
+                        cur = nl + 1;
+                        --left;
+                    }
+                    take = cur - p;
+                }
+                out.put(p, take);
+                used += take;
+                if (take < n && in.fd() == STDIN_FILENO && !in.regular()) break;
+            }
+            in.consumed(used);
+            in.settle();
+        } else {
+            // everything except the last count lines/bytes
+            std::string all;
+            const char *data; size_t size;
+            if ((data = in.map()) != nullptr) size = in.size();
+            else { read_all(in, all); data = all.data(); size = all.size(); }
+            size_t pos = size;
+            if (by_bytes) pos = (unsigned long long)count >= size ? 0 : size - count;
+            else for (long long k = 0; k < count && pos > 0; ++k) pos = line_start_before(data, pos);
+            if (!interrupted) out.put(data, pos);
+        }
+        if (in.error()) { out.flush(); input_error("head", name, in.error()); ret = 1; }
+    }
+    return interrupted ? 130 : ret;
+}
+
+// ---- tail --------------------------------------------------------------
+
+// offset where the last count lines of a regular file begin, reading
+// backward from EOF in fixed blocks
+static off_t tail_lines_offset(int fd, off_t base, off_t size, long long count) {
+    if (count <= 0) return base + size;
+    std::vector<char> buf(kChunkSize);
+    // the final byte ends the last line whether or not it is a newline
+    off_t blk_end = size - 1;
+    long long need = count;
+    while (blk_end > 0 && !interrupted) {
+        off_t blk_start = blk_end > (off_t)buf.size() ? blk_end - buf.size() : 0;
+        ssize_t r = pread(fd, buf.data(), blk_end - blk_start, base + blk_start);
+        if (r != blk_end - blk_start) return base;
+        size_t len = r;
+        while (const void *q = memrchr(buf.data(), '\n', len)) {
+            len = static_cast<const char*>(q) - buf.data();
+            if (--need == 0) return base + blk_start + len + 1;
+        }
+        blk_end = blk_start;
+    }
+    return base; // fewer lines than requested: whole file
+}
+
+int tail_builtin(const CommandLine &cl) {
+    long long count = 10;
+    bool by_bytes = false, from_start = false, follow = false;
+    int headers = 0;
+    std::vector<std::string> files;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (a == "-" || a.size() < 2 || a[0] != '-') { files.push_back(a); continue; }
+        if (a == "--") { files.insert(files.end(), cl.argv.begin() + i + 1, cl.argv.end()); break; }
+        std::string val;
+        bool need_val = false;
+        if (a == "-q" || a == "--quiet" || a == "--silent") { headers = -1; continue; }
+        if (a == "-v" || a == "--verbose") { headers = 1; continue; }
+        if (a == "-f" || a == "-F" || a == "--follow" || a.compare(0, 9, "--follow=") == 0) { follow = true; continue; }
+        if (a == "--retry") continue; // following is always by name, with retry
+        if (isdigit((unsigned char)a[1])) { val = a.substr(1); by_bytes = false; }
+        else if (a[1] == 'n' || a[1] == 'c') {
+            by_bytes = (a[1] == 'c');
+            if (a.size() > 2) val = a.substr(2); else need_val = true;
+        } else if (a.compare(0, 8, "--lines=") == 0) { by_bytes = false; val = a.substr(8); }
+        else if (a.compare(0, 8, "--bytes=") == 0) { by_bytes = true; val = a.substr(8); }
+        else { fprintf(stderr, "tail: invalid option -- '%c'\nTry 'tail --help' for more information.\n", a[1]); return 1; }
+        if (need_val) {
+            if (i + 1 >= cl.argv.size()) { fprintf(stderr, "tail: option requires an argument -- '%c'\n", a[1]); return 1; }
+            val = cl.argv[++i];
+        }
+        char sign;
+        if (!parse_count(val, count, &sign)) {
+            fprintf(stderr, "tail: invalid number of %s: '%s'\n", by_bytes ? "bytes" : "lines", val.c_str());
+            return 1;
+        }
+        from_start = (sign == '+');
+    }
+    if (files.empty()) files.push_back("-");
+    bool show_headers = headers == 1 || (headers == 0 && files.size() > 1);
+
+    int ret = 0;
+    OutBuf out;
+    bool first = true;
+    std::vector<off_t> ends;  // where output stopped, for -f; -1 = not opened
+    int last_header = -1;
+    interrupted = 0;
+    for (const auto &name : files) {
+        if (interrupted) return 130;
+        ends.push_back(-1);
+        Input in;
+        if (!in.open(name)) { out.flush(); open_error("tail", name, errno); ret = 1; continue; }
+        if (in.regular()) ends.back() = in.offset() + in.size();
+        if (show_headers) { print_header(out, name, first); last_header = ends.size() - 1; }
+        first = false;
+        if (from_start) {
+            // +N: skip the first N-1 lines/bytes, copy the rest
+            unsigned long long skip = count > 0 ? count - 1 : 0;
+            const char *p; size_t n;
+            while (in.next(p, n)) {
+                const char *cur = p, *end = p + n;
+                if (by_bytes) {
+                    size_t s = std::min<unsigned long long>(skip, n);
+                    cur += s; skip -= s;
+                } else {
+                    while (skip > 0 && cur < end) {
+                        const char *nl = static_cast<const char*>(memchr(cur, '\n', end - cur));
+                        if (!nl) { cur = end; break; }
+                        cur = nl + 1;
+                        --skip;
+                    }
+                }
+                out.put(cur, end - cur);
+            }
+        } else if (in.regular() && in.size() > 0) {
+            // seek backward from EOF instead of reading the whole file
+            off_t base = in.offset(), end = base + in.size();
+            off_t start = by_bytes ? std::max<off_t>(base, end - (off_t)std::min<long long>(count, in.size()))
+                                   : tail_lines_offset(in.fd(), base, in.size(), count);
+            out.flush();
+            copy_range(in.fd(), start, end - start, out.fd(), -1, true);
+            if (in.fd() == STDIN_FILENO) lseek(in.fd(), end, SEEK_SET);
+        } else {
+            // stream: keep only the chunks that can still hold the tail
+            std::deque<std::string> chunks;
+            std::deque<size_t> nls;
+            size_t kept = 0, kept_nl = 0;
+            const char *p; size_t n;
+            while (in.next(p, n)) {
+                chunks.emplace_back(p, n);
+                size_t c = by_bytes ? 0 : count_newlines(p, n);
+                nls.push_back(c);
+                kept += n; kept_nl += c;
+                while (chunks.size() > 1 &&
+                       (by_bytes ? kept - chunks.front().size() >= (unsigned long long)count
+                                 : kept_nl - nls.front() > (unsigned long long)count)) {
+                    kept -= chunks.front().size(); kept_nl -= nls.front();
+                    chunks.pop_front(); nls.pop_front();
+                }
+            }
+            if (interrupted) return 130;
+            std::string all;
+            all.reserve(kept);
+            for (const auto &c : chunks) all += c;
+            size_t pos = 0;
+            if (by_bytes) pos = (unsigned long long)count >= all.size() ? 0 : all.size() - count;
+            else {
+                pos = all.size();
+                for (long long k = 0; k < count && pos > 0; ++k) pos = line_start_before(all.data(), pos);
+                if (count == 0) pos = all.size();
+            }
+            out.put(all.data() + pos, all.size() - pos);
+        }
+        if (in.error()) { out.flush(); input_error("tail", name, in.error()); ret = 1; }
+    }
+    if (interrupted) return 130;
+    if (follow) {
+        // standard input cannot be followed by name
+        std::vector<std::string> names;
+        std::vector<off_t> offsets;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (files[i] == "-") continue;
+            if (last_header == (int)i) last_header = names.size();
+            names.push_back(files[i]);
+            offsets.push_back(ends[i]);
+        }
+        out.flush();
+        if (!names.empty()) return follow_files(names, offsets, show_headers, last_header);
+    }
+    return ret;
+}
+
+// ---- uniq --------------------------------------------------------------
+
+static bool equal_lines(std::string_view a, std::string_view b, bool icase) {
+    if (a.size() != b.size()) return false;
+    if (!icase) return a == b;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    return true;
+}
+
+int uniq_builtin(const CommandLine &cl) {
+    bool counts = false, only_dups = false, only_uniq = false, icase = false;
+    std::vector<std::string> files;
+    for (size_t i = 1; i < cl.argv.size(); ++i) {
+        const std::string &a = cl.argv[i];
+        if (a == "-" || a.size() < 2 || a[0] != '-') { files.push_back(a); continue; }
+        if (a == "--count") { counts = true; continue; }
+        if (a == "--repeated") { only_dups = true; continue; }
+        if (a == "--unique") { only_uniq = true; continue; }
+        if (a == "--ignore-case") { icase = true; continue; }
+        for (size_t k = 1; k < a.size(); ++k) {
+            switch (a[k]) {
+            case 'c': counts = true; break;
+            case 'd': only_dups = true; break;
+            case 'u': only_uniq = true; break;
+            case 'i': icase = true; break;
+            default:
+                fprintf(stderr, "uniq: invalid option -- '%c'\nTry 'uniq --help' for more information.\n", a[k]);
+                return 1;
+            }
+        }
+    }
+    if (files.size() > 2) { fprintf(stderr, "uniq: extra operand '%s'\n", files[2].c_str()); return 1; }
+    std::string in_name = files.empty() ? "-" : files[0];
+    interrupted = 0;
+    Input in;
+    if (!in.open(in_name)) { input_error("uniq", in_name, errno); return 1; }
+    int out_fd = STDOUT_FILENO;
+    if (files.size() == 2 && files[1] != "-") {
+        out_fd = open(files[1].c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0) { input_error("uniq", files[1], errno); return 1; }
+    }
+
+    int ret = 0;
+    {
+        OutBuf out(out_fd);
+        std::string prev, carry;
+        bool have_prev = false;
+        unsigned long long run = 0;
+        auto emit = [&]() {
+            if ((only_dups && run < 2) || (only_uniq && run > 1)) return;
+            if (counts) { char b[32]; int l = snprintf(b, sizeof(b), "%7llu ", run); out.put(b, l); }
+            out.put(prev);
+            out.put('\n');
+        };
+        auto feed = [&](std::string_view line) {
+            if (have_prev && equal_lines(prev, line, icase)) { ++run; return; }
+            if (have_prev) emit();
+            prev.assign(line.data(), line.size());
+            have_prev = true;
+            run = 1;
+        };
+        const char *p; size_t n;
+        while (in.next(p, n)) {
+            const char *cur = p, *end = p + n;
+            while (cur < end) {
+                const char *nl = static_cast<const char*>(memchr(cur, '\n', end - cur));
+                if (!nl) { carry.append(cur, end - cur); break; }
+                if (!carry.empty()) {
+                    carry.append(cur, nl - cur);
+                    feed(carry);
+                    carry.clear();
+                } else {
+                    feed(std::string_view(cur, nl - cur));
+                }
+                cur = nl + 1;
+            }
+        }
+        if (interrupted) ret = 130;
+        else {
+            if (!carry.empty()) feed(carry);
+            if (have_prev) emit();
+            if (in.error()) { input_error("uniq", in_name, in.error()); ret = 1; }
+        }
+    }
+    if (out_fd != STDOUT_FILENO) close(out_fd);
+    return ret;
+}
@@ -0,0 +1,37 @@
+// text_io.h - buffered output shared by the text-processing builtins
+#ifndef TEAMSHELL_TEXT_IO_H
+#define TEAMSHELL_TEXT_IO_H
+
+#include "fd_io.h"
+#include <unistd.h>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+static const size_t kChunkSize = 256 * 1024;
+
+// buffered writer for stdout (or another fd)
+class OutBuf {
+public:
+    explicit OutBuf(int fd = STDOUT_FILENO) : fd_(fd) { buf_.reserve(kChunkSize); }
+    ~OutBuf() { flush(); }
+    void put(const char *p, size_t n) {
+        if (n >= kChunkSize) { flush(); raw(p, n); return; }
+        if (buf_.size() + n > kChunkSize) flush();
+        buf_.insert(buf_.end(), p, p + n);
+    }
+    void put(std::string_view s) { put(s.data(), s.size()); }
+    void put(char c) { if (buf_.size() + 1 > kChunkSize) flush(); buf_.push_back(c); }
+    void flush() { if (!buf_.empty()) { raw(buf_.data(), buf_.size()); buf_.clear(); } }
+    bool failed() const { return failed_; }
+    int fd() const { return fd_; }
+private:
+    void raw(const char *p, size_t n) {
+        if (!failed_ && !write_all(fd_, p, n)) failed_ = true;
+    }
+    int fd_;
+    std::vector<char> buf_;
+    bool failed_ = false;
+};
+
+#endif // TEAMSHELL_TEXT_IO_H
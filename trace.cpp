@@ -0,0 +1,126 @@
+// trace.cpp - Chrome trace-event writer for TraceSpan
+#include "trace.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+
+bool Tracer::enabled_ = false;
+
+// events are buffered and written in batches of this size
+static const size_t kFlushThreshold = 4096;
+
+Tracer &Tracer::instance() {
+    static Tracer inst;
+    return inst;
+}
+
+uint64_t Tracer::nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void tracer_atexit() {
+    Tracer::instance().disable();
+}
+
+bool Tracer::enable(const std::string &path) {
+    if (enabled_) disable();
+    // O_APPEND: forked children write through the same open file
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) { perror(("trace: " + path).c_str()); return false; }
+    static bool atexit_registered = false;
+    if (!atexit_registered) { atexit(tracer_atexit); atexit_registered = true; }
+    fd_ = fd;
+    path_ = path;
+    root_pid_ = owner_pid_ = (int)getpid();
+    events_.clear();
+    events_.reserve(kFlushThreshold);
+    // a metadata event opens the array so every later event can start
+    // with ",", whichever process writes first
+    char head[160];
+    int n = snprintf(head, sizeof(head),
+                     "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"teamshell\"}}",
+                     root_pid_);
+    if (write(fd_, head, n) != n) perror("trace");
+    enabled_ = true;
+    return true;
+}
+
+void Tracer::disable() {
+    if (!enabled_) return;
+    flush();
+    // only the process that opened the array closes it
+    if ((int)getpid() == root_pid_ && write(fd_, "\n]\n", 3) != 3) perror("trace");
+    close(fd_);
+    fd_ = -1;
+    enabled_ = false;
+}
+
+// first event in a forked child: the inherited buffer belongs to the
+// parent, which writes it itself
+void Tracer::adoptChild() {
+    events_.clear();
+    owner_pid_ = (int)getpid();
+}
+
+void Tracer::record(const char *name, uint64_t start_ns, uint64_t end_ns, const std::string &args) {
+    int pid = (int)getpid();
+    if (pid != owner_pid_) adoptChild();
+    events_.push_back(Event{name, start_ns, end_ns, pid, args});
+    if (events_.size() >= kFlushThreshold) flush();
+}
+
+void Tracer::flush() {
+    if (fd_ < 0) return;
+    if ((int)getpid() != owner_pid_) adoptChild();
+    if (events_.empty()) return;
+    std::string out;
+    out.reserve(events_.size() * 128);
+    char buf[256];
+    for (const auto &e : events_) {
+        snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"cat\":\"teamshell\",\"ph\":\"X\","
+                 "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                 e.name, e.start_ns / 1000.0, (e.end_ns - e.start_ns) / 1000.0, e.pid, e.pid);
+        out += buf;
+        if (!e.args.empty()) { out += ",\"args\":{"; out += e.args; out += "}"; }
+        out += "}";
+    }
+    events_.clear();
+    // fcntl locks are per process, so batches from the shell and its
+    // children never interleave
+    struct flock lk = {};
+    lk.l_type = F_WRLCK;
+    lk.l_whence = SEEK_SET;
+    while (fcntl(fd_, F_SETLKW, &lk) < 0 && errno == EINTR) {}
+    size_t off = 0;
+    while (off < out.size()) {
+        ssize_t n = write(fd_, out.data() + off, out.size() - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { perror("trace"); break; }
+        off += n;
+    }
+    lk.l_type = F_UNLCK;
+    fcntl(fd_, F_SETLK, &lk);
+}
+
+void TraceSpan::arg(const char *key, long long value) {
+    if (!start_ns_) return;
+    if (!args_.empty()) args_ += ",";
+    args_ += "\""; args_ += key; args_ += "\":"; args_ += std::to_string(value);
+}
+
+void TraceSpan::arg(const char *key, const std::string &value) {
+    if (!start_ns_) return;
+    if (!args_.empty()) args_ += ",";
+    args_ += "\""; args_ += key; args_ += "\":\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') { args_.push_back('\\'); args_.push_back(c); }
+        else if ((unsigned char)c < 0x20) args_.push_back(' ');
+        else args_.push_back(c);
+    }
+    args_ += "\"";
+}
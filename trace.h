@@ -0,0 +1,67 @@
+// trace.h - low-overhead hot-path tracing (Chrome trace-event JSON output)
+#ifndef TEAMSHELL_TRACE_H
+#define TEAMSHELL_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tracer collects complete ("ph":"X") events and writes them as a Chrome
+// trace-event JSON array, loadable in chrome://tracing or Perfetto.
+// Enabled by TEAMSHELL_TRACE=<file> or `set -o trace [file]`; when disabled
+// a TraceSpan costs a single load and branch. Forked children keep tracing
+// under their own pid and append their batches to the same file under a
+// record lock, so every process gets its own timeline.
+class Tracer {
+public:
+    static Tracer &instance();
+    static bool enabled() { return enabled_; }
+    static uint64_t nowNs();
+
+    bool enable(const std::string &path);
+    void disable();
+    void flush();
+    // forked children that leave with _exit or exec call this first so
+    // their events reach the trace
+    static void flushBeforeExit() { if (enabled_) instance().flush(); }
+    void record(const char *name, uint64_t start_ns, uint64_t end_ns, const std::string &args);
+    const std::string &path() const { return path_; }
+private:
+    struct Event {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+        int pid;
+        std::string args;
+    };
+    void adoptChild();
+    static bool enabled_;
+    std::vector<Event> events_;
+    std::string path_;
+    int fd_ = -1;
+    int root_pid_ = 0;  // process that enabled tracing and closes the array
+    int owner_pid_ = 0; // process whose events are in events_
+};
+
+// RAII span; name must be a string literal (it is stored by pointer)
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) : name_(name) {
+        if (Tracer::enabled()) start_ns_ = Tracer::nowNs();
+    }
+    ~TraceSpan() {
+        if (start_ns_ && Tracer::enabled())
+            Tracer::instance().record(name_, start_ns_, Tracer::nowNs(), args_);
+    }
+    // attach an integer/string argument shown in the trace viewer
+    void arg(const char *key, long long value);
+    void arg(const char *key, const std::string &value);
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+private:
+    const char *name_;
+    uint64_t start_ns_ = 0;
+    std::string args_;
+};
+
+#endif // TEAMSHELL_TRACE_H
@@ -0,0 +1,265 @@
+// zygote.cpp - fork-server process and its client-side stubs
+#include "zygote.h"
+#include "command.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+int Zygote::sock_ = -1;
+
+enum : uint8_t { kOpSpawn = 1, kOpWait = 2 };
+static const size_t kMaxMessage = 65536;
+// cwd, stdin, stdout, stderr and up to two pipe ends
+static const int kMaxFds = 6;
+
+extern char **environ;
+
+static void put_u32(std::string &buf, uint32_t v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+static void put_str(std::string &buf, const std::string &s) { put_u32(buf, s.size()); buf += s; }
+
+// bounds-checked reader over a received message
+struct MsgReader {
+    const char *p;
+    size_t left;
+    bool ok = true;
+    uint32_t u32() {
+        uint32_t v = 0;
+        if (left < sizeof(v)) { ok = false; return 0; }
+        memcpy(&v, p, sizeof(v)); p += sizeof(v); left -= sizeof(v);
+        return v;
+    }
+    std::string str() {
+        uint32_t n = u32();
+        if (!ok || left < n) { ok = false; return std::string(); }
+        std::string s(p, n); p += n; left -= n;
+        return s;
+    }
+};
+
+static bool send_msg(int sock, const std::string &buf, const int *fds, int nfds) {
+    struct iovec iov = { const_cast<char*>(buf.data()), buf.size() };
+    char cbuf[CMSG_SPACE(kMaxFds * sizeof(int))];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+    }
+    ssize_t n;
+    do { n = sendmsg(sock, &msg, MSG_NOSIGNAL); } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)buf.size();
+}
+
+// receive one message; fds (up to kMaxFds) are returned close-on-exec
+static ssize_t recv_msg(int sock, char *buf, size_t cap, int *fds, int *nfds) {
+    struct iovec iov = { buf, cap };
+    char cbuf[CMSG_SPACE(kMaxFds * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    ssize_t n;
+    do { n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); } while (n < 0 && errno == EINTR);
+    *nfds = 0;
+    if (n <= 0) return n;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int cnt = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < cnt && *nfds < kMaxFds; ++i) memcpy(&fds[(*nfds)++], CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+    }
+    return n;
+}
+
+static int32_t ask(int sock, const std::string &req, const int *fds, int nfds) {
+    if (!send_msg(sock, req, fds, nfds)) return -1;
+    char buf[sizeof(int32_t)];
+    int rfds[kMaxFds]; int rn = 0;
+    if (recv_msg(sock, buf, sizeof(buf), rfds, &rn) != (ssize_t)sizeof(int32_t)) return -1;
+    int32_t v; memcpy(&v, buf, sizeof(v));
+    return v;
+}
+
+// ---- zygote side -------------------------------------------------------
+
+static void zygote_loop(int sock) {
+    // terminal signals aimed at the shell's group must not kill the helper
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    std::map<pid_t, int> finished;   // reaped early, not yet waited for
+    std::set<pid_t> detached;        // background children nobody will wait for
+    std::vector<char> buf(kMaxMessage);
+    while (true) {
+        int fds[kMaxFds]; int nfds = 0;
+        ssize_t n = recv_msg(sock, buf.data(), buf.size(), fds, &nfds);
+        if (n <= 0) _exit(0); // shell went away
+        // collect exited children so background jobs do not linger as zombies
+        int st; pid_t r;
+        while ((r = waitpid(-1, &st, WNOHANG)) > 0) {
+            if (detached.erase(r) == 0) finished[r] = st;
+        }
+        MsgReader rd{buf.data() + 1, (size_t)n - 1};
+        int32_t reply = -1;
+        if (buf[0] == kOpSpawn) {
+            pid_t pgid = (pid_t)rd.u32();
+            uint32_t flags = rd.u32();
+            CommandLine cl;
+            uint32_t argc = rd.u32();
+            for (uint32_t i = 0; rd.ok && i < argc; ++i) cl.argv.push_back(rd.str());
+            uint32_t nredir = rd.u32();
+            for (uint32_t i = 0; rd.ok && i < nredir; ++i) {
+                Redirection r;
+                r.fd = (int)rd.u32();
+                r.dup_from = (int)rd.u32();
+                r.append = rd.u32() != 0;
+                r.path = rd.str();
+                cl.redirections.push_back(r);
+            }
+            StagePlacement placement;
+            uint32_t ncpus = rd.u32();
+            for (uint32_t i = 0; rd.ok && i < ncpus; ++i) placement.cpus.push_back((int)rd.u32());
+            placement.set_nice = rd.u32() != 0;
+            placement.nice = (int)rd.u32();
+            placement.ioprio = (int)rd.u32();
+            std::vector<std::string> env;
+            uint32_t nenv = rd.u32();
+            for (uint32_t i = 0; rd.ok && i < nenv; ++i) env.push_back(rd.str());
+            // the shell's cwd and stdio at spawn time come first
+            int in_fd = -1, out_fd = -1, k = 4;
+            if ((flags & 2) && k < nfds) in_fd = fds[k++];
+            if ((flags & 4) && k < nfds) out_fd = fds[k++];
+            if (rd.ok && nfds >= 4) {
+                pid_t pid = fork();
+                if (pid == 0) {
+                    setpgid(0, pgid);
+                    signal(SIGINT, SIG_DFL);
+                    signal(SIGTSTP, SIG_DFL);
+                    signal(SIGQUIT, SIG_DFL);
+                    if (fchdir(fds[0]) < 0) { perror("zygote: fchdir"); _exit(127); }
+                    for (int s = 0; s < 3; ++s) dup2(fds[1 + s], s);
+                    clearenv();
+                    for (auto &e : env) putenv(&e[0]);
+                    if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+                    if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+                    apply_stage_placement(placement);
+                    exec_command_line(cl);
+                }
+                if (pid > 0) {
+                    setpgid(pid, pgid ? pgid : pid);
+                    if (flags & 1) detached.insert(pid);
+                }
+                reply = pid;
+            }
+            for (int i = 0; i < nfds; ++i) close(fds[i]);
+        } else if (buf[0] == kOpWait) {
+            pid_t pid = (pid_t)rd.u32();
+            auto it = finished.find(pid);
+            if (it != finished.end()) { reply = it->second; finished.erase(it); }
+            else {
+                int status = 0;
+                while ((r = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+                reply = (r == pid) ? status : (1 << 8);
+            }
+        }
+        std::string out;
+        put_u32(out, (uint32_t)reply);
+        send_msg(sock, out, nullptr, 0);
+    }
+}
+
+// ---- shell side --------------------------------------------------------
+
+bool Zygote::start() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) { perror("zygote: socketpair"); return false; }
+    pid_t pid = fork();
+    if (pid < 0) { perror("zygote: fork"); close(sv[0]); close(sv[1]); return false; }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_loop(sv[1]);
+    }
+    close(sv[1]);
+    sock_ = sv[0];
+    return true;
+}
+
+pid_t Zygote::spawn(const CommandLine &cl, pid_t pgid, int in_fd, int out_fd, bool detached,
+                    const StagePlacement &placement) {
+    if (sock_ < 0) return -1;
+    std::string req(1, (char)kOpSpawn);
+    uint32_t flags = (detached ? 1 : 0) | (in_fd >= 0 ? 2 : 0) | (out_fd >= 0 ? 4 : 0);
+    put_u32(req, (uint32_t)pgid);
+    put_u32(req, flags);
+    put_u32(req, cl.argv.size());
+    for (const auto &a : cl.argv) put_str(req, a);
+    put_u32(req, cl.redirections.size());
+    for (const auto &r : cl.redirections) {
+        put_u32(req, (uint32_t)r.fd);
+        put_u32(req, (uint32_t)r.dup_from);
+        put_u32(req, r.append ? 1 : 0);
+        put_str(req, r.path);
+    }
+    put_u32(req, placement.cpus.size());
+    for (int c : placement.cpus) put_u32(req, (uint32_t)c);
+    put_u32(req, placement.set_nice ? 1 : 0);
+    put_u32(req, (uint32_t)placement.nice);
+    put_u32(req, (uint32_t)placement.ioprio);
+    // the child gets the shell's environment, cwd and stdio as they are now
+    uint32_t nenv = 0;
+    for (char **e = environ; e && *e; ++e) nenv++;
+    put_u32(req, nenv);
+    for (char **e = environ; e && *e; ++e) put_str(req, *e);
+    if (req.size() > kMaxMessage) return -1; // too large: caller forks locally
+    int cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd < 0) return -1;
+    int fds[kMaxFds] = { cwd_fd, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    int nfds = 4;
+    if (in_fd >= 0) fds[nfds++] = in_fd;
+    if (out_fd >= 0) fds[nfds++] = out_fd;
+    // a closed stdio fd makes the send fail with EBADF: fork locally then
+    for (int s = 0; s < 3; ++s) {
+        if (fcntl(s, F_GETFD) < 0) { close(cwd_fd); return -1; }
+    }
+    int32_t pid = ask(sock_, req, fds, nfds);
+    close(cwd_fd);
+    if (pid < 0) {
+        // helper is gone or failed to fork; stop using it
+        close(sock_);
+        sock_ = -1;
+        return -1;
+    }
+    return pid;
+}
+
+void Zygote::release() {
+    if (sock_ >= 0) close(sock_);
+    sock_ = -1;
+}
+
+int Zygote::wait(pid_t pid) {
+    if (sock_ < 0) return 1 << 8;
+    std::string req(1, (char)kOpWait);
+    put_u32(req, (uint32_t)pid);
+    int32_t status = ask(sock_, req, nullptr, 0);
+    return status < 0 ? (1 << 8) : status;
+}
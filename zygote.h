@@ -0,0 +1,37 @@
+// zygote.h - fork-server helper for low-latency command launch
+#ifndef TEAMSHELL_ZYGOTE_H
+#define TEAMSHELL_ZYGOTE_H
+
+#include "parser.h"
+#include "placement.h"
+#include <sys/types.h>
+
+// The zygote is a small helper forked at startup, before readline or any
+// per-session state exists. Commands ask it over a socketpair to fork and
+// exec children, so launch cost does not grow with the shell's footprint.
+// Each request carries the shell's environment and, over SCM_RIGHTS, a
+// descriptor for its cwd and its current fds 0-2, so children see `cd`,
+// environment changes and in-process redirections exactly like a local fork.
+// Children are reaped by the zygote and their statuses sent back on wait().
+// Enabled by setting TEAMSHELL_ZYGOTE=1; callers fall back to a local fork
+// whenever available() is false or spawn() returns -1.
+class Zygote {
+public:
+    static bool start();
+    static bool available() { return sock_ >= 0; }
+    // launch cl in process group pgid (0 = new group led by the child);
+    // in_fd/out_fd replace stdin/stdout when >= 0. detached children are
+    // never waited for; placement is applied in the child before exec.
+    // returns the child pid or -1.
+    static pid_t spawn(const CommandLine &cl, pid_t pgid, int in_fd, int out_fd, bool detached,
+                       const StagePlacement &placement);
+    // block until pid exits; returns its raw wait status
+    static int wait(pid_t pid);
+    // drop the helper in a forked copy of the shell: requests on the shared
+    // socket are not serialized across processes, so it launches locally
+    static void release();
+private:
+    static int sock_;
+};
+
+#endif // TEAMSHELL_ZYGOTE_H